@@ -0,0 +1,123 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+
+//Asset pack layout. Offsets are from the start of the file, numbers are
+//little-endian:
+//  PackHeader
+//  PackEntry[EntryCount], sorted by hash, then by name
+//  Names, not null-terminated
+//  Payloads, each starting on a PACK_ALIGNMENT boundary
+//The demo maps the whole file and uses the payloads in place.
+//PackBuilder writes it.
+
+#define PACK_MAGIC     0x4B415054 //"TPAK"
+#define PACK_VERSION   1
+#define PACK_ALIGNMENT 64
+
+struct PackHeader
+{
+  uint32_t Magic;
+  uint32_t Version;
+  uint32_t EntryCount;
+  uint32_t Reserved;
+};
+
+struct PackEntry
+{
+  uint64_t Hash;
+  uint64_t Offset;
+  uint64_t Size;
+  uint32_t NameOffset;
+  uint32_t NameLength;
+};
+
+//FNV-1a
+inline uint64_t PackHash(const char* name, size_t length)
+{
+  uint64_t hash = 0xcbf29ce484222325;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (uint8_t)name[i];
+    hash *= 0x100000001b3;
+  }
+  return hash;
+}
+
+inline bool PackEntryLess(const PackEntry& a, const char* aName, const PackEntry& b, const char* bName)
+{
+  if (a.Hash != b.Hash)
+    return a.Hash < b.Hash;
+  int cmp = memcmp(aName, bName, a.NameLength < b.NameLength ? a.NameLength : b.NameLength);
+  return cmp ? cmp < 0 : a.NameLength < b.NameLength;
+}
+
+//Read-only view of a pack in memory
+struct AssetPack
+{
+  const char*      Data    = nullptr;
+  size_t           Size    = 0;
+  const PackEntry* Entries = nullptr;
+  uint32_t         Count   = 0;
+
+  //Checks that everything the index points at lies inside the pack and that
+  //the index is sorted, so lookups can trust it
+  bool Open(const void* data, size_t size)
+  {
+    if (!data || size < sizeof(PackHeader))
+      return false;
+
+    PackHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (header.Magic != PACK_MAGIC || header.Version != PACK_VERSION)
+      return false;
+    if (header.EntryCount > (size - sizeof(PackHeader)) / sizeof(PackEntry))
+      return false;
+
+    const char* bytes = (const char*)data;
+    const PackEntry* entries = (const PackEntry*)(bytes + sizeof(PackHeader));
+    for (uint32_t i = 0; i < header.EntryCount; i++) {
+      const PackEntry& e = entries[i];
+      if (e.Offset > size || e.Size > size - e.Offset || e.Offset % PACK_ALIGNMENT)
+        return false;
+      if (e.NameOffset > size || e.NameLength > size - e.NameOffset)
+        return false;
+      if (i > 0 && !PackEntryLess(entries[i - 1], bytes + entries[i - 1].NameOffset, e, bytes + e.NameOffset))
+        return false;
+    }
+
+    Data    = bytes;
+    Size    = size;
+    Entries = entries;
+    Count   = header.EntryCount;
+    return true;
+  }
+
+  //Binary search by hash. o_data points into the pack, it is not copied.
+  bool Find(const char* name, const char** o_data, size_t* o_size) const
+  {
+    *o_data = nullptr;
+    *o_size = 0;
+
+    size_t length = strlen(name);
+    uint64_t hash = PackHash(name, length);
+    uint32_t lo = 0;
+    uint32_t hi = Count;
+    while (lo < hi) {
+      uint32_t mid = lo + (hi - lo) / 2;
+      if (Entries[mid].Hash < hash)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+    for (; lo < Count && Entries[lo].Hash == hash; lo++) {
+      const PackEntry& e = Entries[lo];
+      if (e.NameLength == length && memcmp(Data + e.NameOffset, name, length) == 0) {
+        *o_data = Data + e.Offset;
+        *o_size = (size_t)e.Size;
+        return true;
+      }
+    }
+    return false;
+  }
+};
@@ -0,0 +1,117 @@
+#define _CRT_SECURE_NO_WARNINGS
+#include "AssetPack.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+//Writes the given files into one asset pack, each under the name it was given by:
+//  PackBuilder <pack> <file>...
+//The project runs it whenever one of the demo's assets changes.
+
+struct Asset
+{
+  std::string       Name;
+  std::vector<char> Content;
+  PackEntry         Entry = {};
+};
+
+bool ReadWholeFile(const char* path, std::vector<char>& o_content)
+{
+  FILE* file = fopen(path, "rb");
+  if (!file)
+    return false;
+
+  fseek(file, 0, SEEK_END);
+  long size = ftell(file);
+  fseek(file, 0, SEEK_SET);
+  if (size < 0) {
+    fclose(file);
+    return false;
+  }
+
+  o_content.resize(size);
+  bool ok = fread(o_content.data(), 1, o_content.size(), file) == o_content.size();
+  fclose(file);
+  return ok;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    printf("Usage: PackBuilder <pack> <file>...\n");
+    return 1;
+  }
+
+  std::vector<Asset> assets(argc - 2);
+  for (int i = 2; i < argc; i++) {
+    Asset& asset = assets[i - 2];
+    asset.Name = argv[i];
+    if (!ReadWholeFile(argv[i], asset.Content)) {
+      printf("Could not read %s\n", argv[i]);
+      return 1;
+    }
+    asset.Entry.Hash       = PackHash(asset.Name.data(), asset.Name.size());
+    asset.Entry.Size       = asset.Content.size();
+    asset.Entry.NameLength = (uint32_t)asset.Name.size();
+  }
+
+  //The index is sorted for binary search, in the order AssetPack::Open checks
+  std::sort(assets.begin(), assets.end(), [](const Asset& a, const Asset& b) {
+    return PackEntryLess(a.Entry, a.Name.data(), b.Entry, b.Name.data());
+  });
+  for (size_t i = 1; i < assets.size(); i++) {
+    if (assets[i].Name == assets[i - 1].Name) {
+      printf("%s is given twice\n", assets[i].Name.c_str());
+      return 1;
+    }
+  }
+
+  uint64_t offset = sizeof(PackHeader) + assets.size() * sizeof(PackEntry);
+  for (Asset& asset : assets) {
+    asset.Entry.NameOffset = (uint32_t)offset;
+    offset += asset.Name.size();
+  }
+  for (Asset& asset : assets) {
+    offset = (offset + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+    asset.Entry.Offset = offset;
+    offset += asset.Content.size();
+  }
+
+  std::vector<char> pack(offset);
+  PackHeader header = { PACK_MAGIC, PACK_VERSION, (uint32_t)assets.size(), 0 };
+  memcpy(pack.data(), &header, sizeof(header));
+  for (size_t i = 0; i < assets.size(); i++) {
+    const Asset& asset = assets[i];
+    memcpy(pack.data() + sizeof(PackHeader) + i * sizeof(PackEntry), &asset.Entry, sizeof(PackEntry));
+    memcpy(pack.data() + asset.Entry.NameOffset, asset.Name.data(), asset.Name.size());
+    if (!asset.Content.empty())
+      memcpy(pack.data() + asset.Entry.Offset, asset.Content.data(), asset.Content.size());
+  }
+
+  //Written to a temporary file first, so a failed write never leaves a
+  //truncated pack behind for the demo to map
+  std::string tempPath = std::string(argv[1]) + ".tmp";
+  FILE* file = fopen(tempPath.c_str(), "wb");
+  if (!file) {
+    printf("Could not create %s\n", tempPath.c_str());
+    return 1;
+  }
+  bool ok = fwrite(pack.data(), 1, pack.size(), file) == pack.size();
+  ok = fclose(file) == 0 && ok;
+  //rename() won't replace a file on Windows, so the old pack goes first.
+  //Only once the new one is complete, so a failed write keeps it.
+  if (ok) {
+    remove(argv[1]);
+    ok = rename(tempPath.c_str(), argv[1]) == 0;
+  }
+  if (!ok) {
+    printf("Could not write %s\n", argv[1]);
+    remove(tempPath.c_str());
+    return 1;
+  }
+
+  printf("%s: %zu assets, %zu bytes\n", argv[1], assets.size(), pack.size());
+  return 0;
+}
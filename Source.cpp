@@ -3,11 +3,14 @@
 
 #include <stdio.h>
 #include <string_view>
-#include <string>
+#include <future>
+#include <chrono>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#include "AssetPack.h"
+
 #include "glew.h"
 #include "gl/GL.h"
 
@@ -112,23 +115,91 @@ bool RegisterWglFunctions()
   return true;
 }
 
-bool ReadWholeFile(const wchar_t* path, std::string& o_str)
+//Read-only view of a whole file. Pages are read in as they are first touched,
+//so the contents are used in place instead of being copied to the heap.
+//Data is nullptr if the file could not be opened or is empty.
+struct MappedFile
 {
-  HANDLE file = CreateFile(path, GENERIC_READ, FILE_SHARE_WRITE | FILE_SHARE_READ, NULL, OPEN_EXISTING, 0, NULL);
-  if (file == INVALID_HANDLE_VALUE)
-    return false;
-
-  LARGE_INTEGER size;
-  GetFileSizeEx(file, &size);
-  o_str.resize(size.QuadPart);
-  DWORD readCnt;
-  if (!ReadFile(file, o_str.data(), (DWORD)o_str.size(), &readCnt, NULL)) {
+  const char* Data = nullptr;
+  size_t      Size = 0;
+
+  explicit MappedFile(const char* path)
+  {
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_WRITE | FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+      return;
+
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+      HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping) {
+        Data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        Size = Data ? (size_t)size.QuadPart : 0;
+        CloseHandle(mapping); //The view keeps the mapping alive
+      }
+    }
     CloseHandle(file);
-    return false;
   }
 
-  CloseHandle(file);
-  return true;
+  ~MappedFile()
+  {
+    if (!Data)
+      return;
+    UnmapViewOfFile(Data);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  //The whole file is about to be read front to back: start reading it in now
+  void Prefetch() const
+  {
+    if (!Data)
+      return;
+    WIN32_MEMORY_RANGE_ENTRY range = { (void*)Data, Size };
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+  }
+};
+
+//Assets are packed along with the project, so a missing one is fatal
+void FindAsset(const AssetPack& pack, const char* name, const char** o_data, size_t* o_size)
+{
+  if (!pack.Find(name, o_data, o_size)) {
+    printf("%s is missing from the asset pack", name);
+    exit(-1);
+  }
+}
+
+//Upload memory the texture is decoded into. The render thread maps both
+//before the decode starts and unmaps them once it is done.
+struct TextureUpload
+{
+  stbi_target d3d = {};      //Staging texture. The cache reads it back, so it is mapped for reading too.
+  stbi_uc*    gl  = nullptr; //Pixel unpack buffer, mapped write-only. Tightly packed rows.
+  int width  = 0;
+  int height = 0;
+};
+
+//Decodes on a worker thread, so rendering doesn't wait for it.
+//Default stbi_load settings. No flipping: upper left corner is the first pixel.
+//Decoded pixels are kept in TextureCache, so later runs read them back from
+//there instead of decoding again.
+std::future<bool> DecodeAsync(const char* data, size_t size, const char* name, const TextureUpload& upload)
+{
+  return std::async(std::launch::async, [data, size, name, upload]() {
+    //Decoded straight from the mapped pages into the staging texture
+    int width, height, numChannels;
+    if (!stbi_load_into_cached_from_memory((const stbi_uc*)data, (int)size, "TextureCache", &upload.d3d, &width, &height, &numChannels, 4)) {
+      printf("Could not load %s: %s", name, stbi_failure_reason()); //Failure reasons are per thread
+      return false;
+    }
+
+    //The GL buffer can't be read back, so it gets a copy of the rows instead of a second decode
+    const size_t rowBytes = (size_t)upload.width * 4;
+    for (int y = 0; y < upload.height; ++y)
+      memcpy(upload.gl + rowBytes * y, (const stbi_uc*)upload.d3d.pixels + (size_t)upload.d3d.row_pitch * y, rowBytes);
+    return true;
+  });
 }
 
 struct Vec2
@@ -238,6 +309,16 @@ Matrix Ortho_RightHanded_ZeroToOne(float right, float left, float top, float bot
 
 int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nShowCmd)
 {
+  //All assets come from one mapped file, built by PackBuilder along with the
+  //project. Lookups return pointers into the mapping.
+  MappedFile packFile("Assets.pack");
+  AssetPack pack;
+  if (!pack.Open(packFile.Data, packFile.Size)) {
+    printf("Could not open Assets.pack");
+    return -1;
+  }
+  packFile.Prefetch();
+
   //Create window and initialize OpenGL.
   HDC dc;
   {
@@ -383,11 +464,6 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
     ShowWindow(d3dWindow, SW_SHOW);
   }
 
-  //Load the image file with default stbi_load settings. No flipping.
-  //Upper left corner will be the first pixel in the buffer.
-  int texWidth, texHeight, numChannels;
-  stbi_uc* texBuff = stbi_load("Texture.jpg", &texWidth, &texHeight, &numChannels, 4);
-
 //#define ENABLE_3D
 #ifndef ENABLE_3D
   //Quad that we can render our texture to
@@ -477,28 +553,32 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 
 
     {
-      std::string vShaderContent;
+      //Shader sources are compiled from the pack. They aren't null-terminated
+      //there, so their lengths are passed along.
+      const char* vSource;
+      size_t vSize;
 #ifdef ENABLE_3D
-      ReadWholeFile(L"./TexQuadV_3d.glsl", vShaderContent);
+      FindAsset(pack, "TexQuadV_3d.glsl", &vSource, &vSize);
 #else
-      ReadWholeFile(L"./TexQuadV_2d.glsl", vShaderContent);
+      FindAsset(pack, "TexQuadV_2d.glsl", &vSource, &vSize);
 #endif
       GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
 
-      const char* vSource = vShaderContent.c_str();
-      glShaderSource(vShader, 1, &vSource, NULL);
+      GLint vLength = (GLint)vSize;
+      glShaderSource(vShader, 1, &vSource, &vLength);
       glCompileShader(vShader);
 
-      std::string fShaderContent;
+      const char* fSource;
+      size_t fSize;
 #ifdef ENABLE_3D
-      ReadWholeFile(L"./TexQuadF_3d.glsl", fShaderContent);
+      FindAsset(pack, "TexQuadF_3d.glsl", &fSource, &fSize);
 #else
-      ReadWholeFile(L"./TexQuadF_2d.glsl", fShaderContent);
+      FindAsset(pack, "TexQuadF_2d.glsl", &fSource, &fSize);
 #endif
       GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
 
-      const char* fSource = fShaderContent.c_str();
-      glShaderSource(fShader, 1, &fSource, NULL);
+      GLint fLength = (GLint)fSize;
+      glShaderSource(fShader, 1, &fSource, &fLength);
       glCompileShader(fShader);
 
       glShader = glCreateProgram();
@@ -510,9 +590,9 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
       glDeleteShader(vShader);
     }
 
+    //The image itself is uploaded by the render loop
     glGenTextures(1, &glTexId);
     glBindTexture(GL_TEXTURE_2D, glTexId);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texWidth, texHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, texBuff);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
@@ -536,6 +616,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
   }
 
   //DIRECT3D
+  ID3D11Device* device;
   ID3D11DeviceContext* devicecontext;
   IDXGISwapChain* swapchain;
   ID3D11RenderTargetView* rendertargetview;
@@ -554,8 +635,6 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
     swapchaindesc.Windowed          = TRUE;
     swapchaindesc.SwapEffect        = DXGI_SWAP_EFFECT_FLIP_DISCARD;
 
-    ID3D11Device* device;
-
     D3D11CreateDeviceAndSwapChain(0, D3D_DRIVER_TYPE_HARDWARE, 0, 0, 0, 0, 7, &swapchaindesc, &swapchain, &device, 0, &devicecontext);
     swapchain->GetDesc(&swapchaindesc);
 
@@ -567,10 +646,14 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
     ID3D11VertexShader* vertexshader;
     ID3D11PixelShader* pixelshader;
 #ifdef ENABLE_3D
-    D3DCompileFromFile(L"TexQuad_3d.hlsl", 0, 0, "vertex_shader", "vs_5_0", 0, 0, &shaderCompilationOutput, 0);
+    const char* hlslName = "TexQuad_3d.hlsl";
 #else
-    D3DCompileFromFile(L"TexQuad_2d.hlsl", 0, 0, "vertex_shader", "vs_5_0", 0, 0, &shaderCompilationOutput, 0);
+    const char* hlslName = "TexQuad_2d.hlsl";
 #endif
+    const char* hlslSource;
+    size_t hlslSize;
+    FindAsset(pack, hlslName, &hlslSource, &hlslSize);
+    D3DCompile(hlslSource, hlslSize, hlslName, 0, 0, "vertex_shader", "vs_5_0", 0, 0, &shaderCompilationOutput, 0);
     device->CreateVertexShader(shaderCompilationOutput->GetBufferPointer(), shaderCompilationOutput->GetBufferSize(), 0, &vertexshader);
 
 
@@ -588,11 +671,7 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
     ID3D11InputLayout* inputlayout;
     device->CreateInputLayout(inputelementdesc, ARRAYSIZE(inputelementdesc), shaderCompilationOutput->GetBufferPointer(), shaderCompilationOutput->GetBufferSize(), &inputlayout);
 
-#ifdef ENABLE_3D
-    D3DCompileFromFile(L"TexQuad_3d.hlsl", 0, 0, "pixel_shader", "ps_5_0", 0, 0, &shaderCompilationOutput, 0);
-#else
-    D3DCompileFromFile(L"TexQuad_2d.hlsl", 0, 0, "pixel_shader", "ps_5_0", 0, 0, &shaderCompilationOutput, 0);
-#endif
+    D3DCompile(hlslSource, hlslSize, hlslName, 0, 0, "pixel_shader", "ps_5_0", 0, 0, &shaderCompilationOutput, 0);
     device->CreatePixelShader(shaderCompilationOutput->GetBufferPointer(), shaderCompilationOutput->GetBufferSize(), 0, &pixelshader);
 
     //Not strictly necessary but we want to make sure that both implementations show the same side of the quad
@@ -624,28 +703,6 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 
     device->CreateBuffer(&constantbufferdesc, nullptr, &constantbuffer);
 
-    D3D11_TEXTURE2D_DESC texturedesc = {};
-    texturedesc.Width              = texWidth ;
-    texturedesc.Height             = texHeight;
-    texturedesc.MipLevels          = 1;
-    texturedesc.ArraySize          = 1;
-    texturedesc.Format             = DXGI_FORMAT_R8G8B8A8_UNORM;
-    texturedesc.SampleDesc.Count   = 1;
-    texturedesc.Usage              = D3D11_USAGE_IMMUTABLE;
-    texturedesc.BindFlags          = D3D11_BIND_SHADER_RESOURCE;
-
-    D3D11_SUBRESOURCE_DATA textureSRD = {};
-    textureSRD.pSysMem     = texBuff;
-    textureSRD.SysMemPitch = texWidth * sizeof(UINT);
-
-    ID3D11Texture2D* texture;
-
-    device->CreateTexture2D(&texturedesc, &textureSRD, &texture);
-
-    ID3D11ShaderResourceView* textureSRV;
-
-    device->CreateShaderResourceView(texture, nullptr, &textureSRV);
-
     D3D11_BUFFER_DESC vertexbufferdesc = {};
     vertexbufferdesc.ByteWidth = sizeof(vertices);
     vertexbufferdesc.Usage     = D3D11_USAGE_IMMUTABLE;
@@ -677,10 +734,63 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 
     devicecontext->RSSetState(rasterizerstate);
     devicecontext->PSSetSamplers(0, 1, &samplerstate);
-    devicecontext->PSSetShaderResources(0, 1, &textureSRV);
   }
 
+  //Only the image header is read here, to size the upload memory of both APIs.
+  //The worker decodes straight into it while the render loop runs, and the loop
+  //uploads the texture once it is ready, drawing nothing until then.
+  const char* texData;
+  size_t texDataSize;
+  FindAsset(pack, "Texture.jpg", &texData, &texDataSize);
+  TextureUpload upload;
+  int numChannels;
+  if (!stbi_info_from_memory((const stbi_uc*)texData, (int)texDataSize, &upload.width, &upload.height, &numChannels)) {
+    printf("Could not read Texture.jpg: %s", stbi_failure_reason());
+    exit(-1);
+  }
+
+  const size_t texSize = (size_t)upload.width * upload.height * 4;
+  GLuint unpackBuf = 0;
+  glGenBuffers(1, &unpackBuf);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuf);
+  glBufferData(GL_PIXEL_UNPACK_BUFFER, texSize, NULL, GL_STREAM_DRAW);
+  upload.gl = (stbi_uc*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, texSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  D3D11_TEXTURE2D_DESC texturedesc = {};
+  texturedesc.Width              = upload.width ;
+  texturedesc.Height             = upload.height;
+  texturedesc.MipLevels          = 1;
+  texturedesc.ArraySize          = 1;
+  texturedesc.Format             = DXGI_FORMAT_R8G8B8A8_UNORM;
+  texturedesc.SampleDesc.Count   = 1;
+  texturedesc.Usage              = D3D11_USAGE_DEFAULT;
+  texturedesc.BindFlags          = D3D11_BIND_SHADER_RESOURCE;
+
+  //Staging texture with whatever row pitch the driver chose. The GPU copies it
+  //into the texture we sample from.
+  D3D11_TEXTURE2D_DESC stagingdesc = texturedesc;
+  stagingdesc.Usage          = D3D11_USAGE_STAGING;
+  stagingdesc.BindFlags      = 0;
+  stagingdesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ | D3D11_CPU_ACCESS_WRITE;
+
+  ID3D11Texture2D* stagingtexture;
+  device->CreateTexture2D(&stagingdesc, nullptr, &stagingtexture);
+  D3D11_MAPPED_SUBRESOURCE stagingMSR;
+  devicecontext->Map(stagingtexture, 0, D3D11_MAP_READ_WRITE, 0, &stagingMSR);
+  upload.d3d.pixels    = stagingMSR.pData;
+  upload.d3d.size      = (size_t)stagingMSR.RowPitch * upload.height;
+  upload.d3d.row_pitch = (int)stagingMSR.RowPitch;
+  if (!upload.gl || !upload.d3d.pixels) {
+    printf("Could not map the texture upload memory");
+    exit(-1);
+  }
+
+  CreateDirectoryW(L"TextureCache", NULL);
+  std::future<bool> textureLoad = DecodeAsync(texData, texDataSize, "Texture.jpg", upload);
+
   float t = 0;
+  bool textureReady = false;
   while (true) {
     MSG msg;
     while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE) != 0) {
@@ -688,6 +798,33 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
       DispatchMessage(&msg);
     }
 
+    //Upload the texture to both APIs on this thread once the decode is done
+    if (!textureReady && textureLoad.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+      if (!textureLoad.get())
+        exit(-1);
+
+      //With an unpack buffer bound, the data pointer is an offset into it.
+      //Tightly packed RGBA rows satisfy the default GL_UNPACK_ALIGNMENT of 4.
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, unpackBuf);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+      glBindTexture(GL_TEXTURE_2D, glTexId);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, upload.width, upload.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      glDeleteBuffers(1, &unpackBuf);
+
+      devicecontext->Unmap(stagingtexture, 0);
+      ID3D11Texture2D* texture;
+      device->CreateTexture2D(&texturedesc, nullptr, &texture);
+      devicecontext->CopyResource(texture, stagingtexture);
+      stagingtexture->Release();
+
+      ID3D11ShaderResourceView* textureSRV;
+      device->CreateShaderResourceView(texture, nullptr, &textureSRV);
+      devicecontext->PSSetShaderResources(0, 1, &textureSRV);
+
+      textureReady = true;
+    }
+
 #ifdef ENABLE_3D
     Matrix rotY = {
       cos(-t) , 0     , sin(-t), 0,
@@ -734,7 +871,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 #endif
 
       glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-      glDrawArrays(GL_TRIANGLES, 0, NUM_VERTICES);
+      if (textureReady)
+        glDrawArrays(GL_TRIANGLES, 0, NUM_VERTICES);
       SwapBuffers(dc);
     }
 
@@ -764,7 +902,8 @@ int WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int n
 #else
       devicecontext->OMSetRenderTargets(1, &rendertargetview, 0);
 #endif
-      devicecontext->Draw(NUM_VERTICES, 0);
+      if (textureReady)
+        devicecontext->Draw(NUM_VERTICES, 0);
       swapchain->Present(1, 0);
     }
 
@@ -30,7 +30,7 @@
 	  GIF (*comp always reports as 4-channel)
 	  HDR (radiance rgbE format)
 	  PIC (Softimage PIC)
-	  PNM (PPM and PGM binary only)
+	  PNM (PPM and PGM binary only, 8/16 bit-per-channel)
 
 	  Animated GIF still needs a proper API, but here's one way to do it:
 		  http://gist.github.com/urraka/685d9a6340b26b830d49
@@ -163,6 +163,37 @@ RECENT REVISION HISTORY:
 // more user-friendly ones.
 //
 // Paletted PNG, BMP, GIF, and PIC images are automatically depalettized.
+// If you would rather keep the palette (e.g. to upload an 8-bit index texture
+// plus a palette texture), paletted PNG and GIF images can be loaded through
+// the indexed-color interface instead:
+//
+//    stbi_uc palette[256*4];
+//    int palette_len;
+//    unsigned char *indices = stbi_load_indexed(filename, &x, &y, palette, &palette_len);
+//    // ... x*y 8-bit palette indices, palette_len RGBA entries in palette ...
+//
+// This fails for images that aren't paletted. For GIFs only the first frame
+// is returned, and pixels it doesn't cover get the background index.
+//
+// Uncompressed 24/32-bit BMP and TGA files and binary (P5/P6) PNM files
+// already store their pixels in a form a GPU can take directly (BGR/BGRA rows,
+// often bottom-up, or plain RGB/grey rows). If the file is in memory --
+// typically because you mapped it -- you can get a view of those pixels
+// instead of a decoded copy:
+//
+//    stbi_view v;
+//    if (stbi_view_from_memory(mapped, mapped_len, &v)) {
+//       // v.x by v.y pixels of v.bytes_per_pixel bytes, in v.channel_order;
+//       // row j starts at v.pixels + j*v.row_pitch (row_pitch is negative
+//       // for bottom-up data, so row 0 is always the top row)
+//    }
+//
+// Nothing is copied, so the view is only valid as long as the buffer is, and
+// the length is a size_t so mapped files over 2GB work. 16-bit PNM views have
+// v.bits_per_channel 16 and hold big-endian samples. stbi_view_convert() and
+// stbi_view_convert_16() make the usual tightly packed copy, in native byte
+// order, if you need one. Other BMP/TGA variants (paletted, RLE, 16-bit,
+// bitfields) and other formats fail; use the regular loaders for those.
 //
 // ===========================================================================
 //
@@ -176,6 +207,40 @@ RECENT REVISION HISTORY:
 //
 // ===========================================================================
 //
+// SHARED MEMORY CACHE:
+//
+//   Processes on one machine that load the same images can share the decoded
+//   pixels instead of each holding a copy. Compile with
+//       #define STBI_SHARED_CACHE
+//   (POSIX shared memory, so older glibc needs -lrt and strict -std modes need
+//   _POSIX_C_SOURCE 200809L) and load with stbi_load_shared. See
+//   "cross-process cache" below. Windows isn't supported yet: there,
+//   stbi_load_shared decodes every image into private memory.
+//
+// ===========================================================================
+//
+// IO_URING:
+//
+//   On Linux, stbi_load_batch can read its files through io_uring: the reads
+//   of many files go out with one system call, into registered buffers, and
+//   the next files are read while the current ones decode. Compile with
+//       #define STBI_IO_URING
+//   (kernel 5.6 headers; strict -std modes need _GNU_SOURCE, which also gives
+//   the O_DIRECT reads used for big files). Where the kernel refuses io_uring
+//   files are read as usual. Other platforms ignore it.
+//
+// ===========================================================================
+//
+// DECODE STATISTICS:
+//
+//   To see where a load spends its time, compile with
+//       #define STBI_STATS
+//   and pass a stbi_stats to stbi_collect_stats(). Without it the counters
+//   compile away. (Strict -std modes need _POSIX_C_SOURCE 199309L for the
+//   clock.) See "decode statistics" below.
+//
+// ===========================================================================
+//
 // Philosophy
 //
 // stb libraries are designed with the following priorities:
@@ -199,12 +264,30 @@ RECENT REVISION HISTORY:
 //
 // ===========================================================================
 //
+// Multithreading
+//
+// stb_image doesn't create threads, but it can use yours: install a
+// "parallel for" with stbi_set_parallel_for() and decoders that can split an
+// image into independent pieces will run those through it. Currently this is
+// Radiance HDR and RLE-compressed PSD decoded from memory, which are split
+// into bands of scanlines. stbi_probe_files() and stbi_load_batch() also run
+// through it, one file per task, and a batch HDR or PSD image is split
+// further inside its task, so the callback must be re-entrant.
+//
+// The stbi_set_* options are process-wide. To decode on several threads with
+// different options, or to give each load its own allocator and failure
+// reason, go through a stbi_decoder instead (see "decoder contexts" below).
+//
+// ===========================================================================
+//
 // I/O callbacks
 //
 // I/O callbacks allow you to read from arbitrary sources, like packaged
 // files or some other source. Data read from callbacks are processed
 // through a small internal buffer (currently 128 bytes) to try to reduce
-// overhead.
+// overhead. When reads are expensive (network volumes, archives), raise it
+// with stbi_set_read_ahead(); large reads made by a decoder still go
+// straight into their destination rather than through the buffer.
 //
 // The three functions you must define are "read" (reads some bytes of data),
 // "skip" (skips some bytes of data), "eof" (reports if the stream is at the end).
@@ -244,7 +327,8 @@ RECENT REVISION HISTORY:
 //     stbi_hdr_to_ldr_scale(1.0f);
 //
 // (note, do not use _inverse_ constants; stbi_image will invert them
-// appropriately).
+// appropriately). With SSE2 this remap uses a fast pow() approximation, which
+// can differ from the exact result by at most 1 in rare cases.
 //
 // Additionally, there is a new, parallel interface for loading files as
 // (linear) floats to preserve the full dynamic range:
@@ -265,6 +349,15 @@ RECENT REVISION HISTORY:
 //
 //     stbi_is_hdr(char *filename);
 //
+// If the data is headed for the GPU anyway, Radiance files can also be decoded
+// directly to RGBA half-floats (8 bytes per pixel) or to the shared-exponent
+// RGB9E5 format (4 bytes per pixel), skipping the 32-bit float image:
+//
+//     stbi_us      *half  = stbi_load_hdr_half(filename, &x, &y);
+//     unsigned int *rgb9e5 = stbi_load_hdr_rgb9e5(filename, &x, &y);
+//
+// Values too large for the target format are clamped to its maximum.
+//
 // ===========================================================================
 //
 // iPhone PNG support:
@@ -333,6 +426,26 @@ enum
 	STBI_rgb_alpha = 4
 };
 
+enum
+{
+	STBI_ORDER_RGB,
+	STBI_ORDER_BGR
+};
+
+enum
+{
+	STBI_FORMAT_unknown,
+	STBI_FORMAT_jpeg,
+	STBI_FORMAT_png,
+	STBI_FORMAT_bmp,
+	STBI_FORMAT_gif,
+	STBI_FORMAT_psd,
+	STBI_FORMAT_pic,
+	STBI_FORMAT_pnm,
+	STBI_FORMAT_hdr,
+	STBI_FORMAT_tga
+};
+
 #include <stdlib.h>
 typedef unsigned char stbi_uc;
 typedef unsigned short stbi_us;
@@ -383,6 +496,188 @@ extern "C" {
 	STBIDEF stbi_uc* stbi_load_gif_from_memory(stbi_uc const* buffer, int len, int** delays, int* x, int* y, int* z, int* comp, int req_comp);
 #endif
 
+	////////////////////////////////////
+	//
+	// indexed-color interface (paletted PNG and GIF only)
+	//
+	// returns one 8-bit palette index per pixel; 'palette' must hold 256 RGBA
+	// entries (1024 bytes), of which *palette_len are filled in
+
+	STBIDEF stbi_uc* stbi_load_indexed_from_memory(stbi_uc const* buffer, int len, int* x, int* y, stbi_uc* palette, int* palette_len);
+	STBIDEF stbi_uc* stbi_load_indexed_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y, stbi_uc* palette, int* palette_len);
+
+#ifndef STBI_NO_STDIO
+	STBIDEF stbi_uc* stbi_load_indexed(char const* filename, int* x, int* y, stbi_uc* palette, int* palette_len);
+	STBIDEF stbi_uc* stbi_load_indexed_from_file(FILE* f, int* x, int* y, stbi_uc* palette, int* palette_len);
+#endif
+
+	////////////////////////////////////
+	//
+	// decode-into interface
+	//
+	// writes the 8-bit image into memory you provide, e.g. a mapped staging or
+	// upload buffer, instead of returning a new allocation. rows are row_pitch
+	// bytes apart; 0 packs them as tightly as 'alignment' allows. 'pixels' and
+	// row_pitch must both be multiples of 'alignment' (a power of two, 0 or 1
+	// for none). size the memory with stbi_info first: a load fails with
+	// "target too small" if the image doesn't fit. rows hold desired_channels,
+	// or *channels_in_file if that is 0, and padding between rows is left
+	// alone. JPEG and 8-bit PNM write their rows straight into the memory;
+	// other formats decode as usual and are copied in. returns 1 on success,
+	// and on failure the memory may be partly written
+
+	typedef struct
+	{
+		void* pixels;  // first row in memory (the bottom row if flipping on load)
+		size_t size;   // bytes available at 'pixels'
+		int row_pitch;
+		int alignment;
+	} stbi_target;
+
+	STBIDEF int      stbi_load_into_from_memory(stbi_uc const* buffer, int len, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_load_into_from_callbacks(stbi_io_callbacks const* clbk, void* user, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+	STBIDEF int      stbi_load_into(char const* filename, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_load_into_from_file(FILE* f, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+#endif
+
+	////////////////////////////////////
+	//
+	// row sink interface
+	//
+	// instead of returning the 8-bit image, hands it to 'sink' in bands of up
+	// to band_rows finished rows (0 for the default of 16) while decoding goes
+	// on, so bands can be compressed, resized or uploaded as they arrive.
+	// 'rows' holds num_rows tightly packed rows starting at row 'y' of the
+	// image and is only valid during the call. every row arrives exactly once,
+	// but bands come bottom-up for bottom-up BMPs and when flipping on load.
+	// return 0 from the sink to stop the load, which then fails with "aborted".
+	//
+	// JPEG, 8-bit PNM, HDR and BMP without alpha stream from the decoder, so
+	// only one band of output exists at a time (JPEG still holds its decoded
+	// components). other formats decode the whole image, then pass it on in
+	// bands. returns 1 on success
+
+	typedef int (*stbi_row_sink)(void* user, stbi_uc const* rows, int y, int num_rows, int width, int channels);
+
+	STBIDEF int      stbi_stream_from_memory(stbi_uc const* buffer, int len, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_stream_from_callbacks(stbi_io_callbacks const* clbk, void* user, stbi_row_sink sink, void* sink_user, int band_rows, int* x, int* y, int* channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+	STBIDEF int      stbi_stream(char const* filename, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_stream_from_file(FILE* f, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* channels_in_file, int desired_channels);
+#endif
+
+#ifndef STBI_NO_STDIO
+	////////////////////////////////////
+	//
+	// decoded-image cache
+	//
+	// stbi_load and stbi_load_into, but the decoded pixels are also kept in
+	// cache_dir (which must exist), in a file named by a hash of the source
+	// bytes and everything that changes the result: desired_channels, the
+	// flip, unpremultiply and iphone flags, and the HDR-to-LDR gamma and
+	// scale. while the source is unchanged, later loads read the pixels back
+	// and check them against a checksum instead of decoding. the source is
+	// still read and hashed every time, so a changed file is never served
+	// stale. a cache file that is missing, damaged or can't be written just
+	// means a normal decode, and all cache files can be deleted at any time.
+	// _from_memory takes the source bytes, e.g. from a mapped file. the
+	// _into variants read the target back to check and write the cache
+	// file, so it must be readable: not a write-only GPU mapping
+
+	STBIDEF stbi_uc* stbi_load_cached(char const* filename, char const* cache_dir, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF stbi_uc* stbi_load_cached_from_memory(stbi_uc const* buffer, int len, char const* cache_dir, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_load_into_cached(char const* filename, char const* cache_dir, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_load_into_cached_from_memory(stbi_uc const* buffer, int len, char const* cache_dir, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+#endif
+
+#if defined(STBI_SHARED_CACHE) && !defined(STBI_NO_STDIO)
+	////////////////////////////////////
+	//
+	// cross-process cache
+	//
+	// stbi_load, but the decoded image goes into shared memory named after
+	// cache_name (letters, digits, '-' and '_') and the same key as
+	// stbi_load_cached, with the pixels mapped read-only. the first process
+	// to load an image decodes it there; the others map the same pages,
+	// waiting for that decode if it is still going on. each image counts the
+	// loads using it, and the last stbi_release_shared takes it down, so it
+	// stays shared while some process holds it. when it can't be shared (out
+	// of shared memory, or the other decode takes over 10 seconds) the image
+	// is decoded into private memory instead, which stbi_release_shared frees
+	// the same way. returns 1 on success. if the decoding process dies, the
+	// next load notices through a flock and decodes the image again; where
+	// shared memory can't be flocked (macOS) it asks for the decoder's process
+	// id, so processes sharing images there must be in one pid namespace
+
+	typedef struct
+	{
+		stbi_uc const* pixels; // read-only, tightly packed rows
+		int x, y;
+		int channels_in_file;
+		int channels;          // in 'pixels'
+		void* mapping;         // the rest is internal
+		size_t mapping_size;
+		char* name;
+	} stbi_shared_image;
+
+	STBIDEF int      stbi_load_shared(char const* filename, char const* cache_name, stbi_shared_image* image, int desired_channels);
+	STBIDEF void     stbi_release_shared(stbi_shared_image* image);
+#endif
+
+#ifndef STBI_NO_STDIO
+	////////////////////////////////////
+	//
+	// batch loading
+	//
+	// stbi_load for many images, as one stbi_set_parallel_for task each
+	// (one after another without a callback). an item is a file, or a buffer
+	// if filename is NULL. 'done' gets each image as soon as it is decoded,
+	// on the thread that decoded it, so in completion order. it owns
+	// 'pixels' (free with stbi_image_free), which is NULL with failure_reason
+	// set if the load failed. files are read whole first, so images that a
+	// decoder splits into pieces (see stbi_set_parallel_for) are split inside
+	// their task. listing the largest images first balances threads best.
+	// with STBI_IO_URING the files are read ahead in groups of up to 64 and
+	// each group decodes as one stbi_set_parallel_for call.
+	// returns how many images loaded
+
+	typedef struct
+	{
+		char const* filename;  // NULL to load from 'buffer'
+		stbi_uc const* buffer;
+		int len;
+		int desired_channels;
+	} stbi_batch_item;
+
+	typedef void (*stbi_batch_done)(void* user, int index, stbi_uc* pixels, int x, int y, int channels_in_file, const char* failure_reason);
+
+	STBIDEF int      stbi_load_batch(stbi_batch_item const* items, int count, stbi_batch_done done, void* user);
+#endif
+
+	////////////////////////////////////
+	//
+	// zero-copy view interface (uncompressed 24/32-bit BMP and TGA, binary PNM)
+	//
+
+	typedef struct
+	{
+		stbi_uc const* pixels; // top row (bottom row if flipping on load), points into the caller's buffer
+		int x, y;
+		int comp;              // channels in file (for BMP, 3 if the fourth byte doesn't hold alpha)
+		int bits_per_channel;  // 8, or 16 for big-endian samples
+		int bytes_per_pixel;
+		int row_pitch;         // bytes from one row to the next, negative for bottom-up storage
+		int channel_order;     // STBI_ORDER_RGB or STBI_ORDER_BGR
+	} stbi_view;
+
+	STBIDEF int      stbi_view_from_memory(stbi_uc const* buffer, size_t len, stbi_view* view);
+	// copy a view into a regular image, like stbi_load/stbi_load_16 would return
+	STBIDEF stbi_uc* stbi_view_convert(stbi_view const* view, int desired_channels);
+	STBIDEF stbi_us* stbi_view_convert_16(stbi_view const* view, int desired_channels);
+
 #ifdef STBI_WINDOWS_UTF8
 	STBIDEF int stbi_convert_wchar_to_utf8(char* buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -415,6 +710,21 @@ extern "C" {
 #endif
 
 #ifndef STBI_NO_HDR
+	// Radiance HDR only: decode straight to a compact GPU format instead of
+	// 32-bit floats. '_half' returns 4 half-floats per pixel (RGBA16F, alpha 1.0),
+	// '_rgb9e5' one packed shared-exponent word per pixel (R9G9B9E5)
+	STBIDEF stbi_us* stbi_load_hdr_half_from_memory(stbi_uc const* buffer, int len, int* x, int* y);
+	STBIDEF stbi_us* stbi_load_hdr_half_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y);
+	STBIDEF unsigned int* stbi_load_hdr_rgb9e5_from_memory(stbi_uc const* buffer, int len, int* x, int* y);
+	STBIDEF unsigned int* stbi_load_hdr_rgb9e5_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y);
+
+#ifndef STBI_NO_STDIO
+	STBIDEF stbi_us* stbi_load_hdr_half(char const* filename, int* x, int* y);
+	STBIDEF stbi_us* stbi_load_hdr_half_from_file(FILE* f, int* x, int* y);
+	STBIDEF unsigned int* stbi_load_hdr_rgb9e5(char const* filename, int* x, int* y);
+	STBIDEF unsigned int* stbi_load_hdr_rgb9e5_from_file(FILE* f, int* x, int* y);
+#endif
+
 	STBIDEF void   stbi_hdr_to_ldr_gamma(float gamma);
 	STBIDEF void   stbi_hdr_to_ldr_scale(float scale);
 #endif // STBI_NO_HDR
@@ -434,7 +744,7 @@ extern "C" {
 
 
 	// get a VERY brief reason for failure
-	// NOT THREADSAFE
+	// per thread where STBI_THREAD_LOCAL is available, otherwise NOT THREADSAFE
 	STBIDEF const char* stbi_failure_reason(void);
 
 	// free the loaded image -- this is just free()
@@ -451,6 +761,23 @@ extern "C" {
 	STBIDEF int      stbi_info_from_file(FILE* f, int* x, int* y, int* comp);
 	STBIDEF int      stbi_is_16_bit(char const* filename);
 	STBIDEF int      stbi_is_16_bit_from_file(FILE* f);
+
+	// stbi_info for many files at once. each file gets a single unbuffered
+	// read of at most probe_bytes from its start (0 for the default of 16KB,
+	// capped at 64KB) and the header is parsed from that. files are handed to
+	// the stbi_set_parallel_for callback if there is one. a header that isn't
+	// within the bytes read (such as a JPEG with a large EXIF block before its
+	// frame) fails with "probe too short", and stbi_info can still get it.
+	// returns how many files were probed successfully
+	typedef struct
+	{
+		int x, y, comp;             // as stbi_info
+		int bits_per_channel;       // 16 where stbi_is_16_bit, 32 for HDR, 8 otherwise
+		int format;                 // STBI_FORMAT_*, STBI_FORMAT_unknown if the probe failed
+		const char* failure_reason; // why it failed
+	} stbi_probe;
+
+	STBIDEF int      stbi_probe_files(char const* const* filenames, int count, int probe_bytes, stbi_probe* results);
 #endif
 
 
@@ -467,6 +794,161 @@ extern "C" {
 	// flip the image vertically, so the first pixel in the output array is the bottom left
 	STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+	// stb_image never creates threads. work that splits into independent tasks
+	// (currently Radiance HDR and RLE PSD loaded from memory, stbi_probe_files
+	// and stbi_load_batch) is handed to this callback instead; it must run
+	// task(task_data, i) once for every i in [0,count), on any threads in any
+	// order, and return when all are done. it must be re-entrant: a task can
+	// call it again (stbi_load_batch splitting an HDR or PSD image), so a
+	// thread pool behind it must not block its threads waiting on nested
+	// tasks (a work-stealing pool runs them while it waits). pass NULL (the
+	// default) to decode serially
+	typedef void (*stbi_parallel_for)(void* user, void (*task)(void* task_data, int index), void* task_data, int count);
+	STBIDEF void stbi_set_parallel_for(stbi_parallel_for parallel_for, void* user);
+
+	// size of the buffer that _from_file and _from_callbacks loads read through,
+	// picked up when each load starts. above the default 128 bytes it is a heap
+	// block of at most 1MB (larger values are clamped); pass 0 for the default
+	STBIDEF void stbi_set_read_ahead(int bytes);
+
+	////////////////////////////////////
+	//
+	// decoder contexts
+	//
+	// the stbi_set_* toggles above and stbi_failure_reason() are shared by every
+	// load in the process. a stbi_decoder carries its own copy of the options,
+	// an optional allocator and the failure reason, so threads that each use
+	// their own decoder never see one another's settings. zero-initialize it
+	// for the defaults. errors and allocations reach the decoder through a
+	// thread-local, so if STBI_THREAD_LOCAL is unavailable (or
+	// STBI_NO_THREAD_LOCALS is defined) only one decoder may be busy at a time
+
+	// an allocator sets malloc_fn and free_fn together. realloc_fn is optional;
+	// without it a block grows by malloc_fn, a copy and free_fn
+
+	typedef struct
+	{
+		void* (*malloc_fn)(void* user, size_t size);
+		void* (*realloc_fn)(void* user, void* p, size_t oldsize, size_t newsize);
+		void  (*free_fn)(void* user, void* p);
+		void* user;
+	} stbi_allocator;
+
+	typedef struct
+	{
+		int flip_vertically;        // as stbi_set_flip_vertically_on_load
+		int unpremultiply;          // as stbi_set_unpremultiply_on_load
+		int convert_iphone_png;     // as stbi_convert_iphone_png_to_rgb
+		int read_ahead;             // as stbi_set_read_ahead
+		stbi_allocator allocator;   // all NULL: STBI_MALLOC, STBI_REALLOC, STBI_FREE
+		const char* failure_reason; // written when a call through this decoder fails
+	} stbi_decoder;
+
+	STBIDEF stbi_uc* stbi_decoder_load_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF stbi_uc* stbi_decoder_load_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_decoder_load_into_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_decoder_load_into_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_decoder_stream_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_decoder_stream_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, stbi_row_sink sink, void* sink_user, int band_rows, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF stbi_us* stbi_decoder_load_16_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF stbi_us* stbi_decoder_load_16_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* channels_in_file, int desired_channels);
+#ifndef STBI_NO_LINEAR
+	STBIDEF float* stbi_decoder_loadf_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF float* stbi_decoder_loadf_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* channels_in_file, int desired_channels);
+#endif
+	STBIDEF int      stbi_decoder_info_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, int* x, int* y, int* comp);
+	STBIDEF int      stbi_decoder_info_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* comp);
+
+#ifndef STBI_NO_STDIO
+	STBIDEF stbi_uc* stbi_decoder_load_from_file(stbi_decoder* d, FILE* f, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_decoder_load_into_from_file(stbi_decoder* d, FILE* f, stbi_target const* target, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF int      stbi_decoder_stream_from_file(stbi_decoder* d, FILE* f, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* channels_in_file, int desired_channels);
+	STBIDEF stbi_us* stbi_decoder_load_16_from_file(stbi_decoder* d, FILE* f, int* x, int* y, int* channels_in_file, int desired_channels);
+#ifndef STBI_NO_LINEAR
+	STBIDEF float* stbi_decoder_loadf_from_file(stbi_decoder* d, FILE* f, int* x, int* y, int* channels_in_file, int desired_channels);
+#endif
+	STBIDEF int      stbi_decoder_info_from_file(stbi_decoder* d, FILE* f, int* x, int* y, int* comp);
+#endif
+
+	// frees an image with the allocator the decoder was using when it loaded it
+	STBIDEF void     stbi_decoder_image_free(stbi_decoder* d, void* retval_from_stbi_decoder_load);
+
+	// a bump allocator over memory you provide, so a decoder never touches the
+	// heap. everything a load allocates, the image included, stays in the
+	// arena until the reset:
+	//
+	//    stbi_decoder d = { 0 };
+	//    stbi_arena arena;
+	//    stbi_arena_init(&arena, memory, memory_size);
+	//    d.allocator = stbi_arena_allocator(&arena);
+	//    for each image:
+	//       pixels = stbi_decoder_load_from_memory(&d, ...);
+	//       ... consume pixels ...
+	//       stbi_arena_reset(&arena);
+	//
+	// blocks are 16-byte aligned. freeing or growing the most recent block
+	// happens in place (that covers the decoders' growing buffers), any other
+	// free waits for the reset. a load that doesn't fit fails with "outofmem";
+	// high_water records the most any load has needed since init
+
+	typedef struct
+	{
+		stbi_uc* base;
+		size_t size;
+		size_t used;
+		size_t top;        // offset of the most recent block
+		size_t high_water;
+	} stbi_arena;
+
+	STBIDEF void           stbi_arena_init(stbi_arena* arena, void* memory, size_t size);
+	STBIDEF void           stbi_arena_reset(stbi_arena* arena);
+	STBIDEF stbi_allocator stbi_arena_allocator(stbi_arena* arena);
+
+#ifdef STBI_STATS
+	////////////////////////////////////
+	//
+	// decode statistics
+	//
+	// while a stbi_stats is installed, loads on this thread add to it. zero it
+	// and load one image to see that image alone. times are nanoseconds
+	// spent in each stage, not counting stages nested inside it, so the
+	// stages add up to less than the whole load (headers, allocation and
+	// copying aren't listed). timing goes down to single 8x8 JPEG blocks,
+	// which makes a load somewhat slower; compare timed loads with each
+	// other. pieces handed to stbi_set_parallel_for threads are only counted
+	// if those threads install a stbi_stats of their own
+	//
+	//    stbi_stats stats = { 0 };
+	//    stbi_collect_stats(&stats);
+	//    pixels = stbi_load(...);
+	//    stbi_collect_stats(NULL);
+
+#ifdef _MSC_VER
+	typedef unsigned __int64 stbi_stat;
+#else
+	typedef unsigned long long stbi_stat;
+#endif
+
+	typedef struct
+	{
+		stbi_stat entropy_ns;     // JPEG huffman decoding
+		stbi_stat idct_ns;        // JPEG dequantize and inverse DCT
+		stbi_stat upsample_ns;    // JPEG chroma upsampling
+		stbi_stat color_ns;       // JPEG color conversion to the output rows
+		stbi_stat inflate_ns;     // zlib, i.e. PNG image data
+		stbi_stat defilter_ns;    // PNG scanline filters, deinterlacing, bit depths
+		stbi_stat convert_ns;     // conversion to desired_channels
+		stbi_stat bytes_consumed; // input the loads got through, skipped parts included
+		stbi_stat refills;        // reads through the I/O callbacks (files included)
+		stbi_stat allocations;    // mallocs and reallocs
+		stbi_stat zlib_slow;      // zlib codes longer than the fast lookup table
+		stbi_stat jpeg_huff_slow; // JPEG codes longer than the fast lookup table
+	} stbi_stats;
+
+	// NULL to stop collecting
+	STBIDEF void stbi_collect_stats(stbi_stats* stats);
+#endif
+
 	// ZLIB client - used by PNG, available for other purposes
 
 	STBIDEF char* stbi_zlib_decode_malloc_guesssize(const char* buffer, int len, int initial_size, int* outlen);
@@ -541,6 +1023,44 @@ extern "C" {
 #include <stdio.h>
 #endif
 
+#ifdef STBI_STATS
+#include <time.h>
+#endif
+
+#ifndef STBI_NO_STDIO
+#ifdef _MSC_VER
+#include <intrin.h> // _InterlockedIncrement
+#elif !defined(_WIN32)
+#include <unistd.h> // getpid
+#endif
+#endif
+
+#if defined(STBI_SHARED_CACHE) && !defined(STBI_NO_STDIO) && !defined(_WIN32)
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+#endif
+
+#if defined(STBI_IO_URING) && (!defined(__linux__) || defined(STBI_NO_STDIO))
+#undef STBI_IO_URING
+#endif
+
+#ifdef STBI_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
 #ifndef STBI_ASSERT
 #include <assert.h>
 #define STBI_ASSERT(x) assert(x)
@@ -577,6 +1097,14 @@ typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
 #endif
 
+#ifndef STBI_NO_STDIO
+#ifdef _MSC_VER
+typedef unsigned __int64 stbi__uint64;
+#else
+typedef uint64_t stbi__uint64;
+#endif
+#endif
+
 // should produce compiler error if size is wrong
 typedef unsigned char validate_uint32[sizeof(stbi__uint32) == 4 ? 1 : -1];
 
@@ -586,6 +1114,28 @@ typedef unsigned char validate_uint32[sizeof(stbi__uint32) == 4 ? 1 : -1];
 #define STBI_NOTUSED(v)  (void)sizeof(v)
 #endif
 
+#ifndef STBI_NO_THREAD_LOCALS
+#if defined(__cplusplus) && __cplusplus >= 201103L
+#define STBI_THREAD_LOCAL       thread_local
+#elif defined(__GNUC__) && __GNUC__ < 5
+#define STBI_THREAD_LOCAL       __thread
+#elif defined(_MSC_VER)
+#define STBI_THREAD_LOCAL       __declspec(thread)
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__)
+#define STBI_THREAD_LOCAL       _Thread_local
+#endif
+
+#ifndef STBI_THREAD_LOCAL
+#if defined(__GNUC__)
+#define STBI_THREAD_LOCAL       __thread
+#endif
+#endif
+#endif
+
+#ifndef STBI_THREAD_LOCAL
+#define STBI_THREAD_LOCAL
+#endif
+
 #ifdef _MSC_VER
 #define STBI_HAS_LROTL
 #endif
@@ -676,7 +1226,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
 	int info3 = stbi__cpuid3();
@@ -687,7 +1237,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#ifdef STBI_SSE2
 static int stbi__sse2_available(void)
 {
 	// If we're even attempting to compile this on GCC/Clang, that means
@@ -719,6 +1269,20 @@ static int stbi__sse2_available(void)
 //
 //  stbi__context struct and start_xxx functions
 
+// where a stbi_stream load is in handing rows to the sink
+typedef struct
+{
+	stbi_row_sink sink;
+	void* user;
+	int band_rows;
+	int req_comp;
+	stbi_uc* band;    // band_rows rows in the output format
+	stbi_uc* scratch; // one row in the decoder's format, if that differs
+	int x, y, n_in, n_out;
+	int next;         // rows produced so far
+	int reverse;      // the decoder's row j is row y-1-j of the image
+} stbi__stream;
+
 // stbi__context structure is our basic context used by all images, so it
 // contains all the IO context, plus some basic image information
 typedef struct
@@ -732,13 +1296,44 @@ typedef struct
 	int read_from_callbacks;
 	int buflen;
 	stbi_uc buffer_start[128];
+	stbi_uc* buffer; // buffer_start, or a heap block for a larger read-ahead
 
 	stbi_uc* img_buffer, * img_buffer_end;
 	stbi_uc* img_buffer_original, * img_buffer_original_end;
+
+	int flip_vertically; // decoders write rows bottom-to-top
+	int unpremultiply;
+	int de_iphone;
+
+	stbi__stream* stream; // stbi_stream loads, NULL otherwise
+
+	stbi_uc* target; // stbi_load_into memory, NULL for the allocating loads
+	size_t target_size;
+	size_t target_pitch; // 0 to pack rows as tightly as target_align allows
+	size_t target_align;
 } stbi__context;
 
+static int stbi__vertically_flip_on_load = 0;
+static int stbi__unpremultiply_on_load = 0;
+static int stbi__de_iphone_flag = 0;
+static int stbi__read_ahead = 0;
+
+#define STBI__MAX_READ_AHEAD (1 << 20)
+
+// where row 'j' of an image 'h' rows tall goes in the output
+#define stbi__out_row(s, j, h)  ((s)->flip_vertically ? (h) - 1 - (j) : (j))
+
 
 static void stbi__refill_buffer(stbi__context* s);
+static void* stbi__malloc(size_t size);
+static void stbi__free(void* p);
+
+static void stbi__global_options(stbi__context* s)
+{
+	s->flip_vertically = stbi__vertically_flip_on_load;
+	s->unpremultiply = stbi__unpremultiply_on_load;
+	s->de_iphone = stbi__de_iphone_flag;
+}
 
 // initialize a memory-decode context
 static void stbi__start_mem(stbi__context* s, stbi_uc const* buffer, int len)
@@ -747,18 +1342,48 @@ static void stbi__start_mem(stbi__context* s, stbi_uc const* buffer, int len)
 	s->read_from_callbacks = 0;
 	s->img_buffer = s->img_buffer_original = (stbi_uc*)buffer;
 	s->img_buffer_end = s->img_buffer_original_end = (stbi_uc*)buffer + len;
+	s->stream = NULL;
+	s->target = NULL;
+	stbi__global_options(s);
 }
 
-// initialize a callback-based context
-static void stbi__start_callbacks(stbi__context* s, stbi_io_callbacks* c, void* user)
+// initialize a callback-based context reading 'read_ahead' bytes at a time
+static void stbi__start_callbacks_buffered(stbi__context* s, stbi_io_callbacks* c, void* user, int read_ahead)
 {
 	s->io = *c;
 	s->io_user_data = user;
+	s->buffer = s->buffer_start;
 	s->buflen = sizeof(s->buffer_start);
+	if (read_ahead > STBI__MAX_READ_AHEAD)
+		read_ahead = STBI__MAX_READ_AHEAD;
+	if (read_ahead > s->buflen) {
+		// if this fails the built-in buffer still works, just with more reads
+		stbi_uc* block = (stbi_uc*)stbi__malloc(read_ahead);
+		if (block) {
+			s->buffer = block;
+			s->buflen = read_ahead;
+		}
+	}
 	s->read_from_callbacks = 1;
-	s->img_buffer_original = s->buffer_start;
+	s->img_buffer_original = s->buffer;
 	stbi__refill_buffer(s);
 	s->img_buffer_original_end = s->img_buffer_end;
+	s->stream = NULL;
+	s->target = NULL;
+	stbi__global_options(s);
+}
+
+// initialize a callback-based context
+static void stbi__start_callbacks(stbi__context* s, stbi_io_callbacks* c, void* user)
+{
+	stbi__start_callbacks_buffered(s, c, user, stbi__read_ahead);
+}
+
+// every stbi__start_callbacks (and stbi__start_file) needs one of these
+static void stbi__stop_callbacks(stbi__context* s)
+{
+	if (s->buffer != s->buffer_start)
+		stbi__free(s->buffer);
 }
 
 #ifndef STBI_NO_STDIO
@@ -803,12 +1428,6 @@ static void stbi__rewind(stbi__context* s)
 	s->img_buffer_end = s->img_buffer_original_end;
 }
 
-enum
-{
-	STBI_ORDER_RGB,
-	STBI_ORDER_BGR
-};
-
 typedef struct
 {
 	int bits_per_channel;
@@ -827,6 +1446,7 @@ static int      stbi__png_test(stbi__context* s);
 static void* stbi__png_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri);
 static int      stbi__png_info(stbi__context* s, int* x, int* y, int* comp);
 static int      stbi__png_is16(stbi__context* s);
+static stbi_uc* stbi__png_load_indexed(stbi__context* s, int* x, int* y, stbi_uc* palette, int* palette_len);
 #endif
 
 #ifndef STBI_NO_BMP
@@ -852,6 +1472,17 @@ static int      stbi__psd_is16(stbi__context* s);
 static int      stbi__hdr_test(stbi__context* s);
 static float* stbi__hdr_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri);
 static int      stbi__hdr_info(stbi__context* s, int* x, int* y, int* comp);
+static void* stbi__hdr_load_packed(stbi__context* s, int* x, int* y, int format);
+static void* stbi__hdr_load_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, int format);
+
+// output formats for stbi__hdr_load_main
+enum
+{
+	STBI__HDR_float,   // req_comp floats per pixel
+	STBI__HDR_half,    // RGBA half-floats, alpha = 1.0
+	STBI__HDR_rgb9e5,  // one packed shared-exponent word per pixel
+	STBI__HDR_ldr      // req_comp bytes per pixel, as stbi__hdr_to_ldr makes them
+};
 #endif
 
 #ifndef STBI_NO_PIC
@@ -865,33 +1496,140 @@ static int      stbi__gif_test(stbi__context* s);
 static void* stbi__gif_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri);
 static void* stbi__load_gif_main(stbi__context* s, int** delays, int* x, int* y, int* z, int* comp, int req_comp);
 static int      stbi__gif_info(stbi__context* s, int* x, int* y, int* comp);
+static stbi_uc* stbi__gif_load_indexed(stbi__context* s, int* x, int* y, stbi_uc* palette, int* palette_len);
 #endif
 
 #ifndef STBI_NO_PNM
 static int      stbi__pnm_test(stbi__context* s);
 static void* stbi__pnm_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri);
 static int      stbi__pnm_info(stbi__context* s, int* x, int* y, int* comp);
+static int      stbi__pnm_is16(stbi__context* s);
+static int      stbi__pnm_view(stbi__context* s, size_t len, stbi_view* view);
 #endif
 
-// this is not threadsafe
-static const char* stbi__g_failure_reason;
+// without STBI_THREAD_LOCAL these are shared by all threads
+static STBI_THREAD_LOCAL const char* stbi__g_failure_reason;
+static STBI_THREAD_LOCAL stbi_decoder* stbi__active_decoder; // decoder running on this thread
 
 STBIDEF const char* stbi_failure_reason(void)
 {
 	return stbi__g_failure_reason;
 }
 
+static void stbi__set_failure_reason(const char* str)
+{
+	if (stbi__active_decoder)
+		stbi__active_decoder->failure_reason = str;
+	else
+		stbi__g_failure_reason = str;
+}
+
 static int stbi__err(const char* str)
 {
-	stbi__g_failure_reason = str;
+	stbi__set_failure_reason(str);
 	return 0;
 }
 
+#ifdef STBI_STATS
+static STBI_THREAD_LOCAL stbi_stats* stbi__stats;
+static STBI_THREAD_LOCAL stbi_stat stbi__stats_booked; // all time booked to stages so far
+static STBI_THREAD_LOCAL stbi_stat stbi__stats_lap;
+
+STBIDEF void stbi_collect_stats(stbi_stats* stats)
+{
+	stbi__stats = stats;
+}
+
+static stbi_stat stbi__stats_now(void)
+{
+	struct timespec t;
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#else
+	timespec_get(&t, TIME_UTC);
+#endif
+	return (stbi_stat)t.tv_sec * 1000000000u + (stbi_stat)t.tv_nsec;
+}
+
+// a stage's own time is its elapsed time less what stages nested in it
+// booked meanwhile. both come out of one number: the clock minus the
+// booked total, which stands still while nothing runs nested
+static stbi_stat stbi__stats_begin(void)
+{
+	return stbi__stats_now() - stbi__stats_booked;
+}
+
+static void stbi__stats_end(stbi_stat* field, stbi_stat begin)
+{
+	stbi_stat own = stbi__stats_now() - stbi__stats_booked - begin;
+	*field += own;
+	stbi__stats_booked += own;
+}
+
+// books the time of 'stmt' (a call or assignment) to a stage
+#define STBI__STATS_TIME(field, stmt) \
+	do { \
+		if (stbi__stats) { \
+			stbi_stat stbi__stats_begun = stbi__stats_begin(); \
+			stmt; \
+			stbi__stats_end(&stbi__stats->field, stbi__stats_begun); \
+		} else { \
+			stmt; \
+		} \
+	} while (0)
+
+// for loops that go from stage to stage: each lap books the time since the
+// previous one (or the start) to a stage
+#define STBI__STATS_LAP_START()    (stbi__stats ? (void)(stbi__stats_lap = stbi__stats_begin()) : (void)0)
+#define STBI__STATS_LAP(field)     (stbi__stats ? (void)(stbi__stats_end(&stbi__stats->field, stbi__stats_lap), stbi__stats_lap = stbi__stats_begin()) : (void)0)
+#define STBI__STATS_COUNT(field, n) (stbi__stats ? (void)(stbi__stats->field += (n)) : (void)0)
+#else
+#define STBI__STATS_TIME(field, stmt) stmt
+#define STBI__STATS_LAP_START()    ((void)0)
+#define STBI__STATS_LAP(field)     ((void)0)
+#define STBI__STATS_COUNT(field, n) ((void)0)
+#endif
+
 static void* stbi__malloc(size_t size)
 {
+	stbi_decoder* d = stbi__active_decoder;
+	STBI__STATS_COUNT(allocations, 1);
+	if (d && d->allocator.malloc_fn)
+		return d->allocator.malloc_fn(d->allocator.user, size);
 	return STBI_MALLOC(size);
 }
 
+static void* stbi__realloc_sized(void* p, size_t oldsize, size_t newsize)
+{
+	stbi_decoder* d = stbi__active_decoder;
+	STBI__STATS_COUNT(allocations, 1);
+	if (d && d->allocator.realloc_fn)
+		return d->allocator.realloc_fn(d->allocator.user, p, oldsize, newsize);
+	if (d && d->allocator.malloc_fn) {
+		// no realloc_fn: p belongs to the allocator, so grow it by hand. a
+		// shrink keeps the block, as realloc may
+		void* q;
+		if (p && newsize <= oldsize) return p;
+		q = d->allocator.malloc_fn(d->allocator.user, newsize);
+		if (q && p) {
+			memcpy(q, p, oldsize);
+			d->allocator.free_fn(d->allocator.user, p);
+		}
+		return q;
+	}
+	STBI_NOTUSED(oldsize);
+	return STBI_REALLOC_SIZED(p, oldsize, newsize);
+}
+
+static void stbi__free(void* p)
+{
+	stbi_decoder* d = stbi__active_decoder;
+	if (d && d->allocator.free_fn)
+		d->allocator.free_fn(d->allocator.user, p);
+	else
+		STBI_FREE(p);
+}
+
 // stb_image uses ints pervasively, including for offset calculations.
 // therefore the largest decoded image size we can support with the
 // current code, even on 64-bit targets, is INT_MAX. this is not a
@@ -938,13 +1676,11 @@ static int stbi__mad3sizes_valid(int a, int b, int c, int add)
 }
 
 // returns 1 if "a*b*c*d + add" has no negative terms/factors and doesn't overflow
-#if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR)
 static int stbi__mad4sizes_valid(int a, int b, int c, int d, int add)
 {
 	return stbi__mul2sizes_valid(a, b) && stbi__mul2sizes_valid(a * b, c) &&
 		stbi__mul2sizes_valid(a * b * c, d) && stbi__addsizes_valid(a * b * c * d, add);
 }
-#endif
 
 // mallocs with size overflow checking
 static void* stbi__malloc_mad2(int a, int b, int add)
@@ -959,12 +1695,46 @@ static void* stbi__malloc_mad3(int a, int b, int c, int add)
 	return stbi__malloc(a * b * c + add);
 }
 
-#if !defined(STBI_NO_LINEAR) || !defined(STBI_NO_HDR)
 static void* stbi__malloc_mad4(int a, int b, int c, int d, int add)
 {
 	if (!stbi__mad4sizes_valid(a, b, c, d, add)) return NULL;
 	return stbi__malloc(a * b * c * d + add);
 }
+
+// distance between rows of 'row_bytes' in the stbi_load_into target
+static size_t stbi__target_pitch(stbi__context* s, size_t row_bytes)
+{
+	if (s->target_pitch) return s->target_pitch;
+	return (row_bytes + s->target_align - 1) & ~(s->target_align - 1);
+}
+
+// returns 1 if 'rows' rows of 'row_bytes', with 'extra' bytes to write off
+// the end of the last one, fit in the stbi_load_into target
+static int stbi__target_fits(stbi__context* s, size_t row_bytes, int extra, stbi__uint32 rows)
+{
+	size_t pitch = stbi__target_pitch(s, row_bytes);
+	if (row_bytes == 0 || rows == 0) return 1;
+	if (pitch < row_bytes || row_bytes + extra > s->target_size) return 0;
+	return (s->target_size - row_bytes - extra) / pitch >= rows - 1;
+}
+
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_PNM)
+// nothing
+#else
+// output for decoders that produce the final 8-bit 'n'-channel rows
+// themselves: the stbi_load_into target when they fit there, so nothing is
+// copied afterwards, otherwise a packed allocation. '*pitch' is the distance
+// between rows either way
+static stbi_uc* stbi__alloc_rows(stbi__context* s, int n, int extra, size_t* pitch)
+{
+	size_t row_bytes = (size_t)s->img_x * n;
+	if (s->target && stbi__target_fits(s, row_bytes, extra, s->img_y)) {
+		*pitch = stbi__target_pitch(s, row_bytes);
+		return s->target;
+	}
+	*pitch = row_bytes;
+	return (stbi_uc*)stbi__malloc_mad3(n, s->img_x, s->img_y, extra);
+}
 #endif
 
 // stbi__err - error
@@ -995,48 +1765,146 @@ static float* stbi__ldr_to_hdr(stbi_uc* data, int x, int y, int comp);
 static stbi_uc* stbi__hdr_to_ldr(float* data, int x, int y, int comp);
 #endif
 
-static int stbi__vertically_flip_on_load = 0;
-
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 {
 	stbi__vertically_flip_on_load = flag_true_if_should_flip;
 }
 
-static void* stbi__load_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri, int bpc)
+static stbi_parallel_for stbi__parallel_for = NULL;
+static void* stbi__parallel_for_user = NULL;
+
+STBIDEF void stbi_set_parallel_for(stbi_parallel_for parallel_for, void* user)
+{
+	stbi__parallel_for = parallel_for;
+	stbi__parallel_for_user = user;
+}
+
+STBIDEF void stbi_set_read_ahead(int bytes)
+{
+	stbi__read_ahead = bytes;
+}
+
+// every format but TGA opens with its own signature, so the first few bytes
+// are enough to pick the one decoder worth probing, instead of letting each
+// decoder read and rewind in turn. TGA has no signature and stays the fallback
+enum
+{
+	STBI__FORMAT_unknown = STBI_FORMAT_unknown,
+	STBI__FORMAT_jpeg = STBI_FORMAT_jpeg,
+	STBI__FORMAT_png = STBI_FORMAT_png,
+	STBI__FORMAT_bmp = STBI_FORMAT_bmp,
+	STBI__FORMAT_gif = STBI_FORMAT_gif,
+	STBI__FORMAT_psd = STBI_FORMAT_psd,
+	STBI__FORMAT_pic = STBI_FORMAT_pic,
+	STBI__FORMAT_pnm = STBI_FORMAT_pnm,
+	STBI__FORMAT_hdr = STBI_FORMAT_hdr
+};
+
+static const struct
+{
+	const char* magic;
+	int len;
+	int format;
+} stbi__format_magic[] =
+{
+#ifndef STBI_NO_JPEG
+   { "\xFF", 1, STBI__FORMAT_jpeg }, // fill bytes may precede the SOI marker
+#endif
+#ifndef STBI_NO_PNG
+   { "\x89PNG\r\n\x1a\n", 8, STBI__FORMAT_png },
+#endif
+#ifndef STBI_NO_BMP
+   { "BM", 2, STBI__FORMAT_bmp },
+#endif
+#ifndef STBI_NO_GIF
+   { "GIF8", 4, STBI__FORMAT_gif },
+#endif
+#ifndef STBI_NO_PSD
+   { "8BPS", 4, STBI__FORMAT_psd },
+#endif
+#ifndef STBI_NO_PIC
+   { "\x53\x80\xF6\x34", 4, STBI__FORMAT_pic },
+#endif
+#ifndef STBI_NO_PNM
+   { "P5", 2, STBI__FORMAT_pnm },
+   { "P6", 2, STBI__FORMAT_pnm },
+#endif
+#ifndef STBI_NO_HDR
+   { "#?RADIANCE\n", 11, STBI__FORMAT_hdr },
+   { "#?RGBE\n", 7, STBI__FORMAT_hdr },
+#endif
+   { "", 0, STBI__FORMAT_unknown }
+};
+
+// looks at the bytes a rewind returns to, so it never touches the stream
+static int stbi__sniff_format(stbi__context* s)
+{
+	stbi_uc const* p = s->img_buffer_original;
+	int i, avail = (int)(s->img_buffer_original_end - p);
+	for (i = 0; stbi__format_magic[i].len; ++i)
+		if (stbi__format_magic[i].len <= avail && memcmp(p, stbi__format_magic[i].magic, stbi__format_magic[i].len) == 0)
+			return stbi__format_magic[i].format;
+	return STBI__FORMAT_unknown;
+}
+
+static void* stbi__load_format(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri, int bpc)
 {
 	memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
 	ri->bits_per_channel = 8; // default is 8 so most paths don't have to be changed
 	ri->channel_order = STBI_ORDER_RGB; // all current input & output are this, but this is here so we can add BGR order
 	ri->num_channels = 0;
 
+	// the signature only nominates a decoder; its own test still has the final say
+	switch (stbi__sniff_format(s)) {
 #ifndef STBI_NO_JPEG
-	if (stbi__jpeg_test(s)) return stbi__jpeg_load(s, x, y, comp, req_comp, ri);
+	case STBI__FORMAT_jpeg:
+		if (stbi__jpeg_test(s)) return stbi__jpeg_load(s, x, y, comp, req_comp, ri);
+		break;
 #endif
 #ifndef STBI_NO_PNG
-	if (stbi__png_test(s))  return stbi__png_load(s, x, y, comp, req_comp, ri);
+	case STBI__FORMAT_png:
+		if (stbi__png_test(s))  return stbi__png_load(s, x, y, comp, req_comp, ri);
+		break;
 #endif
 #ifndef STBI_NO_BMP
-	if (stbi__bmp_test(s))  return stbi__bmp_load(s, x, y, comp, req_comp, ri);
+	case STBI__FORMAT_bmp:
+		if (stbi__bmp_test(s))  return stbi__bmp_load(s, x, y, comp, req_comp, ri);
+		break;
 #endif
 #ifndef STBI_NO_GIF
-	if (stbi__gif_test(s))  return stbi__gif_load(s, x, y, comp, req_comp, ri);
+	case STBI__FORMAT_gif:
+		if (stbi__gif_test(s))  return stbi__gif_load(s, x, y, comp, req_comp, ri);
+		break;
 #endif
 #ifndef STBI_NO_PSD
-	if (stbi__psd_test(s))  return stbi__psd_load(s, x, y, comp, req_comp, ri, bpc);
+	case STBI__FORMAT_psd:
+		if (stbi__psd_test(s))  return stbi__psd_load(s, x, y, comp, req_comp, ri, bpc);
+		break;
 #endif
 #ifndef STBI_NO_PIC
-	if (stbi__pic_test(s))  return stbi__pic_load(s, x, y, comp, req_comp, ri);
+	case STBI__FORMAT_pic:
+		if (stbi__pic_test(s))  return stbi__pic_load(s, x, y, comp, req_comp, ri);
+		break;
 #endif
 #ifndef STBI_NO_PNM
-	if (stbi__pnm_test(s))  return stbi__pnm_load(s, x, y, comp, req_comp, ri);
+	case STBI__FORMAT_pnm:
+		if (stbi__pnm_test(s))  return stbi__pnm_load(s, x, y, comp, req_comp, ri);
+		break;
 #endif
-
 #ifndef STBI_NO_HDR
-	if (stbi__hdr_test(s)) {
-		float* hdr = stbi__hdr_load(s, x, y, comp, req_comp, ri);
-		return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
-	}
+	case STBI__FORMAT_hdr:
+		if (stbi__hdr_test(s)) {
+			float* hdr;
+			if (s->stream) // tone-map each scanline as it goes to the sink
+				return stbi__hdr_load_main(s, x, y, comp, req_comp, STBI__HDR_ldr);
+			hdr = stbi__hdr_load(s, x, y, comp, req_comp, ri);
+			return stbi__hdr_to_ldr(hdr, *x, *y, req_comp ? req_comp : *comp);
+		}
+		break;
 #endif
+	default:
+		break;
+	}
 
 #ifndef STBI_NO_TGA
 	// test tga last because it's a crappy test!
@@ -1047,75 +1915,110 @@ static void* stbi__load_main(stbi__context* s, int* x, int* y, int* comp, int re
 	return stbi__errpuc("unknown image type", "Image not of any known type, or corrupt");
 }
 
-static stbi_uc* stbi__convert_16_to_8(stbi__uint16* orig, int w, int h, int channels)
+static void* stbi__load_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri, int bpc)
 {
-	int i;
-	int img_len = w * h * channels;
-	stbi_uc* reduced;
+	void* result = stbi__load_format(s, x, y, comp, req_comp, ri, bpc);
+#ifdef STBI_STATS
+	// refills counted everything the callbacks delivered
+	if (stbi__stats) {
+		if (!s->io.read)
+			stbi__stats->bytes_consumed += s->img_buffer - s->img_buffer_original;
+		else if (s->read_from_callbacks) // else past EOF, the buffer holds no file data
+			stbi__stats->bytes_consumed -= s->img_buffer_end - s->img_buffer;
+	}
+#endif
+	return result;
+}
 
-	reduced = (stbi_uc*)stbi__malloc(img_len);
-	if (reduced == NULL) return stbi__errpuc("outofmem", "Out of memory");
+// narrows in place: front to back, each store lands below the samples not
+// yet read. the upper half of the block is then given back
+static stbi_uc* stbi__convert_16_to_8(stbi__uint16* orig, int w, int h, int channels)
+{
+	size_t i = 0;
+	size_t img_len = (size_t)w * h * channels;
+	stbi_uc* reduced = (stbi_uc*)orig;
+	void* shrunk;
 
-	for (i = 0; i < img_len; ++i)
+	if (img_len == 0) return reduced; // realloc to 0 bytes could free the block
+#ifdef STBI_SSE2
+	if (stbi__sse2_available()) {
+		for (; i + 16 <= img_len; i += 16) {
+			__m128i a = _mm_srli_epi16(_mm_loadu_si128((__m128i const*) (orig + i)), 8);
+			__m128i b = _mm_srli_epi16(_mm_loadu_si128((__m128i const*) (orig + i + 8)), 8);
+			_mm_storeu_si128((__m128i*) (reduced + i), _mm_packus_epi16(a, b));
+		}
+	}
+#endif
+#ifdef STBI_NEON
+	for (; i + 16 <= img_len; i += 16)
+		vst1q_u8(reduced + i, vcombine_u8(vshrn_n_u16(vld1q_u16(orig + i), 8), vshrn_n_u16(vld1q_u16(orig + i + 8), 8)));
+#endif
+	for (; i < img_len; ++i)
 		reduced[i] = (stbi_uc)((orig[i] >> 8) & 0xFF); // top half of each byte is sufficient approx of 16->8 bit scaling
 
-	STBI_FREE(orig);
-	return reduced;
+	// if the shrink fails, the block is simply bigger than it needs to be
+	shrunk = stbi__realloc_sized(orig, img_len * 2, img_len);
+	return shrunk ? (stbi_uc*)shrunk : reduced;
 }
 
+// grows the block once, then widens in place: back to front, each store lands
+// at or above the samples just read
 static stbi__uint16* stbi__convert_8_to_16(stbi_uc* orig, int w, int h, int channels)
 {
-	int i;
-	int img_len = w * h * channels;
+	size_t i;
+	size_t img_len = (size_t)w * h * channels;
 	stbi__uint16* enlarged;
+	stbi_uc const* src;
 
-	enlarged = (stbi__uint16*)stbi__malloc(img_len * 2);
-	if (enlarged == NULL) return (stbi__uint16*)stbi__errpuc("outofmem", "Out of memory");
+	if (img_len == 0) return (stbi__uint16*)orig; // realloc to 0 bytes could free the block
+	enlarged = (stbi__uint16*)stbi__realloc_sized(orig, img_len, img_len * 2);
+	if (enlarged == NULL) {
+		stbi__free(orig);
+		return (stbi__uint16*)stbi__errpuc("outofmem", "Out of memory");
+	}
+	src = (stbi_uc const*)enlarged;
 
-	for (i = 0; i < img_len; ++i)
-		enlarged[i] = (stbi__uint16)((orig[i] << 8) + orig[i]); // replicate to high and low byte, maps 0->0, 255->0xffff
+	i = img_len;
+#ifdef STBI_SSE2
+	if (stbi__sse2_available()) {
+		for (; i >= 16; i -= 16) {
+			__m128i v = _mm_loadu_si128((__m128i const*) (src + i - 16));
+			_mm_storeu_si128((__m128i*) (enlarged + i - 8), _mm_unpackhi_epi8(v, v));
+			_mm_storeu_si128((__m128i*) (enlarged + i - 16), _mm_unpacklo_epi8(v, v));
+		}
+	}
+#endif
+#ifdef STBI_NEON
+	for (; i >= 16; i -= 16) {
+		uint8x16_t v = vld1q_u8(src + i - 16);
+		uint16x8_t lo = vmovl_u8(vget_low_u8(v)), hi = vmovl_u8(vget_high_u8(v));
+		vst1q_u16(enlarged + i - 8, vorrq_u16(hi, vshlq_n_u16(hi, 8)));
+		vst1q_u16(enlarged + i - 16, vorrq_u16(lo, vshlq_n_u16(lo, 8)));
+	}
+#endif
+	while (i > 0) {
+		--i;
+		enlarged[i] = (stbi__uint16)((src[i] << 8) + src[i]); // replicate to high and low byte, maps 0->0, 255->0xffff
+	}
 
-	STBI_FREE(orig);
 	return enlarged;
 }
 
-static void stbi__vertical_flip(void* image, int w, int h, int bytes_per_pixel)
+// big-endian 16-bit samples (as in PNM) to native order; 'dest' may alias 'src'
+static void stbi__swap16_from_be(stbi__uint16* dest, stbi_uc const* src, size_t count)
 {
-	int row;
-	size_t bytes_per_row = (size_t)w * bytes_per_pixel;
-	stbi_uc temp[2048];
-	stbi_uc* bytes = (stbi_uc*)image;
-
-	for (row = 0; row < (h >> 1); row++) {
-		stbi_uc* row0 = bytes + row * bytes_per_row;
-		stbi_uc* row1 = bytes + (h - row - 1) * bytes_per_row;
-		// swap row0 with row1
-		size_t bytes_left = bytes_per_row;
-		while (bytes_left) {
-			size_t bytes_copy = (bytes_left < sizeof(temp)) ? bytes_left : sizeof(temp);
-			memcpy(temp, row0, bytes_copy);
-			memcpy(row0, row1, bytes_copy);
-			memcpy(row1, temp, bytes_copy);
-			row0 += bytes_copy;
-			row1 += bytes_copy;
-			bytes_left -= bytes_copy;
+	size_t i = 0;
+#ifdef STBI_SSE2
+	if (stbi__sse2_available()) {
+		for (; i + 8 <= count; i += 8) {
+			__m128i v = _mm_loadu_si128((__m128i const*) (src + i * 2));
+			_mm_storeu_si128((__m128i*) (dest + i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
 		}
 	}
-}
-
-#ifndef STBI_NO_GIF
-static void stbi__vertical_flip_slices(void* image, int w, int h, int z, int bytes_per_pixel)
-{
-	int slice;
-	int slice_size = w * h * bytes_per_pixel;
-
-	stbi_uc* bytes = (stbi_uc*)image;
-	for (slice = 0; slice < z; ++slice) {
-		stbi__vertical_flip(bytes, w, h, bytes_per_pixel);
-		bytes += slice_size;
-	}
-}
 #endif
+	for (; i < count; ++i)
+		dest[i] = (stbi__uint16)((src[i * 2] << 8) | src[i * 2 + 1]);
+}
 
 static unsigned char* stbi__load_and_postprocess_8bit(stbi__context* s, int* x, int* y, int* comp, int req_comp)
 {
@@ -1127,17 +2030,12 @@ static unsigned char* stbi__load_and_postprocess_8bit(stbi__context* s, int* x,
 
 	if (ri.bits_per_channel != 8) {
 		STBI_ASSERT(ri.bits_per_channel == 16);
-		result = stbi__convert_16_to_8((stbi__uint16*)result, *x, *y, req_comp == 0 ? *comp : req_comp);
+		STBI__STATS_TIME(convert_ns, result = stbi__convert_16_to_8((stbi__uint16*)result, *x, *y, req_comp == 0 ? *comp : req_comp));
 		ri.bits_per_channel = 8;
 	}
 
 	// @TODO: move stbi__convert_format to here
 
-	if (stbi__vertically_flip_on_load) {
-		int channels = req_comp ? req_comp : *comp;
-		stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi_uc));
-	}
-
 	return (unsigned char*)result;
 }
 
@@ -1151,30 +2049,108 @@ static stbi__uint16* stbi__load_and_postprocess_16bit(stbi__context* s, int* x,
 
 	if (ri.bits_per_channel != 16) {
 		STBI_ASSERT(ri.bits_per_channel == 8);
-		result = stbi__convert_8_to_16((stbi_uc*)result, *x, *y, req_comp == 0 ? *comp : req_comp);
+		STBI__STATS_TIME(convert_ns, result = stbi__convert_8_to_16((stbi_uc*)result, *x, *y, req_comp == 0 ? *comp : req_comp));
 		ri.bits_per_channel = 16;
 	}
 
 	// @TODO: move stbi__convert_format16 to here
 	// @TODO: special case RGB-to-Y (and RGBA-to-YA) for 8-bit-to-16-bit case to keep more precision
 
-	if (stbi__vertically_flip_on_load) {
-		int channels = req_comp ? req_comp : *comp;
-		stbi__vertical_flip(result, *x, *y, channels * sizeof(stbi__uint16));
-	}
-
 	return (stbi__uint16*)result;
 }
 
-#if !defined(STBI_NO_HDR) && !defined(STBI_NO_LINEAR)
-static void stbi__float_postprocess(float* result, int* x, int* y, int* comp, int req_comp)
+#define STBI__STREAM_BAND_ROWS 16
+
+static int stbi__stream_main(stbi__context* s, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* comp, int req_comp)
 {
-	if (stbi__vertically_flip_on_load && result != NULL) {
-		int channels = req_comp ? req_comp : *comp;
-		stbi__vertical_flip(result, *x, *y, channels * sizeof(float));
-	}
+	stbi__stream st;
+	stbi_uc* result;
+	int j, ok = 1;
+
+	if (req_comp < 0 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+	memset(&st, 0, sizeof(st));
+	st.sink = sink;
+	st.user = user;
+	st.band_rows = band_rows > 0 ? band_rows : STBI__STREAM_BAND_ROWS;
+	st.req_comp = req_comp;
+	s->stream = &st;
+
+	result = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
+	if (result != NULL && result != st.band) {
+		// the decoder built the whole image; pass it on a band at a time
+		int n = req_comp ? req_comp : *comp;
+		size_t row_bytes = (size_t)*x * n;
+		for (j = 0; j < *y && ok; j += st.band_rows)
+			ok = sink(user, result + row_bytes * j, j, *y - j < st.band_rows ? *y - j : st.band_rows, *x, n);
+		stbi__free(result);
+	}
+	stbi__free(st.band);
+	stbi__free(st.scratch);
+	if (!ok) return stbi__err("aborted", "Row sink stopped the load");
+	return result != NULL;
+}
+
+// checks 'target' and makes it the context's stbi_load_into memory
+static int stbi__set_target(stbi__context* s, stbi_target const* target)
+{
+	size_t align = target->alignment > 1 ? (size_t)target->alignment : 1;
+
+	if (align & (align - 1)) return stbi__err("bad alignment", "Alignment must be a power of two");
+	if (target->row_pitch < 0 || ((size_t)target->pixels | (size_t)target->row_pitch) & (align - 1))
+		return stbi__err("bad alignment", "Target memory or row pitch not aligned");
+
+	s->target = (stbi_uc*)target->pixels;
+	s->target_size = target->size;
+	s->target_pitch = (size_t)target->row_pitch;
+	s->target_align = align;
+	return 1;
+}
+
+static int stbi__load_into_main(stbi__context* s, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	stbi_uc* result;
+	size_t row_bytes, pitch;
+	int j;
+
+	if (!stbi__set_target(s, target))
+		return 0;
+
+	result = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
+	if (result == NULL)
+		return 0;
+	if (result == s->target)
+		return 1; // decoded in place
+
+	// the decoder produced a packed image of its own; flipping was already
+	// applied, so this is a plain row-by-row copy
+	row_bytes = (size_t)*x * (req_comp ? req_comp : *comp);
+	if (!stbi__target_fits(s, row_bytes, 0, (stbi__uint32)*y)) {
+		stbi__free(result);
+		return stbi__err("target too small", "Image doesn't fit the target memory");
+	}
+	pitch = stbi__target_pitch(s, row_bytes);
+	for (j = 0; j < *y; ++j)
+		memcpy(s->target + pitch * j, result + row_bytes * j, row_bytes);
+	stbi__free(result);
+	return 1;
 }
+
+static stbi_uc* stbi__load_indexed_main(stbi__context* s, int* x, int* y, stbi_uc* palette, int* palette_len)
+{
+	stbi_uc* result = NULL;
+
+#ifndef STBI_NO_PNG
+	if (stbi__png_test(s)) result = stbi__png_load_indexed(s, x, y, palette, palette_len);
+	else
+#endif
+#ifndef STBI_NO_GIF
+	if (stbi__gif_test(s)) result = stbi__gif_load_indexed(s, x, y, palette, palette_len);
+	else
 #endif
+		return stbi__errpuc("not paletted", "Indexed loading needs a paletted PNG or GIF");
+
+	return result;
+}
 
 #ifndef STBI_NO_STDIO
 
@@ -1239,6 +2215,7 @@ STBIDEF stbi_uc* stbi_load_from_file(FILE* f, int* x, int* y, int* comp, int req
 		// need to 'unget' all the characters in the IO buffer
 		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
 	}
+	stbi__stop_callbacks(&s);
 	return result;
 }
 
@@ -1252,6 +2229,7 @@ STBIDEF stbi__uint16* stbi_load_from_file_16(FILE* f, int* x, int* y, int* comp,
 		// need to 'unget' all the characters in the IO buffer
 		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
 	}
+	stbi__stop_callbacks(&s);
 	return result;
 }
 
@@ -1265,6 +2243,78 @@ STBIDEF stbi_us* stbi_load_16(char const* filename, int* x, int* y, int* comp, i
 	return result;
 }
 
+STBIDEF stbi_uc* stbi_load_indexed(char const* filename, int* x, int* y, stbi_uc* palette, int* palette_len)
+{
+	FILE* f = stbi__fopen(filename, "rb");
+	stbi_uc* result;
+	if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+	result = stbi_load_indexed_from_file(f, x, y, palette, palette_len);
+	fclose(f);
+	return result;
+}
+
+STBIDEF stbi_uc* stbi_load_indexed_from_file(FILE* f, int* x, int* y, stbi_uc* palette, int* palette_len)
+{
+	stbi_uc* result;
+	stbi__context s;
+	stbi__start_file(&s, f);
+	result = stbi__load_indexed_main(&s, x, y, palette, palette_len);
+	if (result) {
+		// need to 'unget' all the characters in the IO buffer
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	}
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
+STBIDEF int stbi_load_into(char const* filename, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	FILE* f = stbi__fopen(filename, "rb");
+	int result;
+	if (!f) return stbi__err("can't fopen", "Unable to open file");
+	result = stbi_load_into_from_file(f, target, x, y, comp, req_comp);
+	fclose(f);
+	return result;
+}
+
+STBIDEF int stbi_load_into_from_file(FILE* f, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi__start_file(&s, f);
+	result = stbi__load_into_main(&s, target, x, y, comp, req_comp);
+	if (result) {
+		// need to 'unget' all the characters in the IO buffer
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	}
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
+STBIDEF int stbi_stream(char const* filename, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* comp, int req_comp)
+{
+	FILE* f = stbi__fopen(filename, "rb");
+	int result;
+	if (!f) return stbi__err("can't fopen", "Unable to open file");
+	result = stbi_stream_from_file(f, sink, user, band_rows, x, y, comp, req_comp);
+	fclose(f);
+	return result;
+}
+
+STBIDEF int stbi_stream_from_file(FILE* f, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi__start_file(&s, f);
+	result = stbi__stream_main(&s, sink, user, band_rows, x, y, comp, req_comp);
+	if (result) {
+		// need to 'unget' all the characters in the IO buffer
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	}
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
 
 #endif //!STBI_NO_STDIO
 
@@ -1277,9 +2327,12 @@ STBIDEF stbi_us* stbi_load_16_from_memory(stbi_uc const* buffer, int len, int* x
 
 STBIDEF stbi_us* stbi_load_16_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* channels_in_file, int desired_channels)
 {
+	stbi_us* result;
 	stbi__context s;
 	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
-	return stbi__load_and_postprocess_16bit(&s, x, y, channels_in_file, desired_channels);
+	result = stbi__load_and_postprocess_16bit(&s, x, y, channels_in_file, desired_channels);
+	stbi__stop_callbacks(&s);
+	return result;
 }
 
 STBIDEF stbi_uc* stbi_load_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* comp, int req_comp)
@@ -1291,26 +2344,73 @@ STBIDEF stbi_uc* stbi_load_from_memory(stbi_uc const* buffer, int len, int* x, i
 
 STBIDEF stbi_uc* stbi_load_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* comp, int req_comp)
 {
+	stbi_uc* result;
 	stbi__context s;
 	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
-	return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+	result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
+STBIDEF int stbi_load_into_from_memory(stbi_uc const* buffer, int len, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	return stbi__load_into_main(&s, target, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const* clbk, void* user, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
+	result = stbi__load_into_main(&s, target, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
+STBIDEF int stbi_stream_from_memory(stbi_uc const* buffer, int len, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* comp, int req_comp)
+{
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	return stbi__stream_main(&s, sink, user, band_rows, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_stream_from_callbacks(stbi_io_callbacks const* clbk, void* user, stbi_row_sink sink, void* sink_user, int band_rows, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
+	result = stbi__stream_main(&s, sink, sink_user, band_rows, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	return result;
 }
 
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc* stbi_load_gif_from_memory(stbi_uc const* buffer, int len, int** delays, int* x, int* y, int* z, int* comp, int req_comp)
 {
-	unsigned char* result;
 	stbi__context s;
 	stbi__start_mem(&s, buffer, len);
+	return (unsigned char*)stbi__load_gif_main(&s, delays, x, y, z, comp, req_comp);
+}
+#endif
 
-	result = (unsigned char*)stbi__load_gif_main(&s, delays, x, y, z, comp, req_comp);
-	if (stbi__vertically_flip_on_load) {
-		stbi__vertical_flip_slices(result, *x, *y, *z, *comp);
-	}
+STBIDEF stbi_uc* stbi_load_indexed_from_memory(stbi_uc const* buffer, int len, int* x, int* y, stbi_uc* palette, int* palette_len)
+{
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	return stbi__load_indexed_main(&s, x, y, palette, palette_len);
+}
 
+STBIDEF stbi_uc* stbi_load_indexed_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y, stbi_uc* palette, int* palette_len)
+{
+	stbi_uc* result;
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
+	result = stbi__load_indexed_main(&s, x, y, palette, palette_len);
+	stbi__stop_callbacks(&s);
 	return result;
 }
-#endif
 
 #ifndef STBI_NO_LINEAR
 static float* stbi__loadf_main(stbi__context* s, int* x, int* y, int* comp, int req_comp)
@@ -1319,10 +2419,7 @@ static float* stbi__loadf_main(stbi__context* s, int* x, int* y, int* comp, int
 #ifndef STBI_NO_HDR
 	if (stbi__hdr_test(s)) {
 		stbi__result_info ri;
-		float* hdr_data = stbi__hdr_load(s, x, y, comp, req_comp, &ri);
-		if (hdr_data)
-			stbi__float_postprocess(hdr_data, x, y, comp, req_comp);
-		return hdr_data;
+		return stbi__hdr_load(s, x, y, comp, req_comp, &ri);
 	}
 #endif
 	data = stbi__load_and_postprocess_8bit(s, x, y, comp, req_comp);
@@ -1340,9 +2437,12 @@ STBIDEF float* stbi_loadf_from_memory(stbi_uc const* buffer, int len, int* x, in
 
 STBIDEF float* stbi_loadf_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* comp, int req_comp)
 {
+	float* result;
 	stbi__context s;
 	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
-	return stbi__loadf_main(&s, x, y, comp, req_comp);
+	result = stbi__loadf_main(&s, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	return result;
 }
 
 #ifndef STBI_NO_STDIO
@@ -1358,9 +2458,12 @@ STBIDEF float* stbi_loadf(char const* filename, int* x, int* y, int* comp, int r
 
 STBIDEF float* stbi_loadf_from_file(FILE* f, int* x, int* y, int* comp, int req_comp)
 {
+	float* result;
 	stbi__context s;
 	stbi__start_file(&s, f);
-	return stbi__loadf_main(&s, x, y, comp, req_comp);
+	result = stbi__loadf_main(&s, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	return result;
 }
 #endif // !STBI_NO_STDIO
 
@@ -1404,6 +2507,7 @@ STBIDEF int stbi_is_hdr_from_file(FILE* f)
 	stbi__start_file(&s, f);
 	res = stbi__hdr_test(&s);
 	fseek(f, pos, SEEK_SET);
+	stbi__stop_callbacks(&s);
 	return res;
 #else
 	STBI_NOTUSED(f);
@@ -1415,9 +2519,12 @@ STBIDEF int stbi_is_hdr_from_file(FILE* f)
 STBIDEF int      stbi_is_hdr_from_callbacks(stbi_io_callbacks const* clbk, void* user)
 {
 #ifndef STBI_NO_HDR
+	int result;
 	stbi__context s;
 	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
-	return stbi__hdr_test(&s);
+	result = stbi__hdr_test(&s);
+	stbi__stop_callbacks(&s);
+	return result;
 #else
 	STBI_NOTUSED(clbk);
 	STBI_NOTUSED(user);
@@ -1425,49 +2532,174 @@ STBIDEF int      stbi_is_hdr_from_callbacks(stbi_io_callbacks const* clbk, void*
 #endif
 }
 
-#ifndef STBI_NO_LINEAR
-static float stbi__l2h_gamma = 2.2f, stbi__l2h_scale = 1.0f;
-
-STBIDEF void   stbi_ldr_to_hdr_gamma(float gamma) { stbi__l2h_gamma = gamma; }
-STBIDEF void   stbi_ldr_to_hdr_scale(float scale) { stbi__l2h_scale = scale; }
-#endif
-
-static float stbi__h2l_gamma_i = 1.0f / 2.2f, stbi__h2l_scale_i = 1.0f;
-
-STBIDEF void   stbi_hdr_to_ldr_gamma(float gamma) { stbi__h2l_gamma_i = 1 / gamma; }
-STBIDEF void   stbi_hdr_to_ldr_scale(float scale) { stbi__h2l_scale_i = 1 / scale; }
-
-
-//////////////////////////////////////////////////////////////////////////////
-//
-// Common code used by all image loaders
-//
-
-enum
+#ifndef STBI_NO_HDR
+STBIDEF stbi_us* stbi_load_hdr_half_from_memory(stbi_uc const* buffer, int len, int* x, int* y)
 {
-	STBI__SCAN_load = 0,
-	STBI__SCAN_type,
-	STBI__SCAN_header
-};
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	return (stbi_us*)stbi__hdr_load_packed(&s, x, y, STBI__HDR_half);
+}
 
-static void stbi__refill_buffer(stbi__context* s)
+STBIDEF stbi_us* stbi_load_hdr_half_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y)
 {
-	int n = (s->io.read)(s->io_user_data, (char*)s->buffer_start, s->buflen);
-	if (n == 0) {
-		// at end of file, treat same as if from memory, but need to handle case
-		// where s->img_buffer isn't pointing to safe memory, e.g. 0-byte file
-		s->read_from_callbacks = 0;
-		s->img_buffer = s->buffer_start;
-		s->img_buffer_end = s->buffer_start + 1;
-		*s->img_buffer = 0;
-	}
-	else {
-		s->img_buffer = s->buffer_start;
-		s->img_buffer_end = s->buffer_start + n;
-	}
+	stbi_us* result;
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
+	result = (stbi_us*)stbi__hdr_load_packed(&s, x, y, STBI__HDR_half);
+	stbi__stop_callbacks(&s);
+	return result;
 }
 
-stbi_inline static stbi_uc stbi__get8(stbi__context* s)
+STBIDEF unsigned int* stbi_load_hdr_rgb9e5_from_memory(stbi_uc const* buffer, int len, int* x, int* y)
+{
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	return (unsigned int*)stbi__hdr_load_packed(&s, x, y, STBI__HDR_rgb9e5);
+}
+
+STBIDEF unsigned int* stbi_load_hdr_rgb9e5_from_callbacks(stbi_io_callbacks const* clbk, void* user, int* x, int* y)
+{
+	unsigned int* result;
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
+	result = (unsigned int*)stbi__hdr_load_packed(&s, x, y, STBI__HDR_rgb9e5);
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
+#ifndef STBI_NO_STDIO
+STBIDEF stbi_us* stbi_load_hdr_half(char const* filename, int* x, int* y)
+{
+	stbi_us* result;
+	FILE* f = stbi__fopen(filename, "rb");
+	if (!f) return (stbi_us*)stbi__errpuc("can't fopen", "Unable to open file");
+	result = stbi_load_hdr_half_from_file(f, x, y);
+	fclose(f);
+	return result;
+}
+
+STBIDEF stbi_us* stbi_load_hdr_half_from_file(FILE* f, int* x, int* y)
+{
+	stbi_us* result;
+	stbi__context s;
+	stbi__start_file(&s, f);
+	result = (stbi_us*)stbi__hdr_load_packed(&s, x, y, STBI__HDR_half);
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
+STBIDEF unsigned int* stbi_load_hdr_rgb9e5(char const* filename, int* x, int* y)
+{
+	unsigned int* result;
+	FILE* f = stbi__fopen(filename, "rb");
+	if (!f) return (unsigned int*)stbi__errpuc("can't fopen", "Unable to open file");
+	result = stbi_load_hdr_rgb9e5_from_file(f, x, y);
+	fclose(f);
+	return result;
+}
+
+STBIDEF unsigned int* stbi_load_hdr_rgb9e5_from_file(FILE* f, int* x, int* y)
+{
+	unsigned int* result;
+	stbi__context s;
+	stbi__start_file(&s, f);
+	result = (unsigned int*)stbi__hdr_load_packed(&s, x, y, STBI__HDR_rgb9e5);
+	stbi__stop_callbacks(&s);
+	return result;
+}
+#endif // !STBI_NO_STDIO
+#endif // !STBI_NO_HDR
+
+#ifndef STBI_NO_LINEAR
+static float stbi__l2h_gamma = 2.2f, stbi__l2h_scale = 1.0f;
+
+// ldr value -> linear float for the current gamma & scale. it starts out
+// filled in for the defaults, so loads only ever read it; the setters rebuild
+// it, and like every stbi_set_* option they mustn't race with loads
+static float stbi__l2h_table[256] = {
+	0.0f, 5.07705136e-06f, 2.33280025e-05f, 5.69217555e-05f, 0.000107187356f, 0.000175123962f, 0.000261543726f, 0.000367136206f,
+	0.00049250375f, 0.000638182799f, 0.000804658455f, 0.000992374262f, 0.00120173942f, 0.00143313443f, 0.00168691506f, 0.00196341588f,
+	0.0022629532f, 0.00258582551f, 0.00293231825f, 0.00330270291f, 0.00369723933f, 0.00411617709f, 0.00455975486f, 0.00502820313f,
+	0.00552174449f, 0.00604059314f, 0.00658495678f, 0.00715503655f, 0.00775102666f, 0.00837311707f, 0.00902149081f, 0.00969632808f,
+	0.010397803f, 0.0111260824f, 0.0118813347f, 0.0126637202f, 0.0134733971f, 0.0143105192f, 0.0151752383f, 0.0160677005f,
+	0.0169880521f, 0.0179364327f, 0.0189129822f, 0.0199178383f, 0.0209511314f, 0.0220129937f, 0.0231035557f, 0.0242229421f,
+	0.0253712758f, 0.0265486818f, 0.0277552791f, 0.0289911851f, 0.0302565172f, 0.0315513909f, 0.0328759141f, 0.0342302062f,
+	0.0356143676f, 0.0370285138f, 0.0384727456f, 0.039947167f, 0.04145189f, 0.0429870076f, 0.0445526242f, 0.0461488403f,
+	0.0477757566f, 0.0494334623f, 0.0511220545f, 0.0528416298f, 0.0545922816f, 0.0563740991f, 0.0581871793f, 0.0600316115f,
+	0.0619074777f, 0.063814871f, 0.0657538846f, 0.067724593f, 0.0697270855f, 0.0717614517f, 0.0738277659f, 0.075926125f,
+	0.0780565888f, 0.0802192613f, 0.0824142098f, 0.0846415088f, 0.086901255f, 0.089193508f, 0.0915183574f, 0.0938758701f,
+	0.0962661207f, 0.0986891985f, 0.101145163f, 0.103634097f, 0.106156066f, 0.108711153f, 0.111299418f, 0.113920934f,
+	0.116575778f, 0.119264014f, 0.121985711f, 0.124740943f, 0.12752977f, 0.130352274f, 0.133208513f, 0.136098549f,
+	0.139022455f, 0.14198029f, 0.144972131f, 0.14799802f, 0.151058048f, 0.154152259f, 0.157280728f, 0.160443515f,
+	0.163640663f, 0.166872263f, 0.170138374f, 0.173439026f, 0.176774323f, 0.18014428f, 0.183548987f, 0.186988503f,
+	0.190462872f, 0.193972155f, 0.197516426f, 0.20109573f, 0.204710111f, 0.208359644f, 0.212044388f, 0.215764388f,
+	0.219519734f, 0.223310426f, 0.227136552f, 0.230998144f, 0.234895274f, 0.238828003f, 0.242796376f, 0.246800438f,
+	0.250840247f, 0.254915863f, 0.259027362f, 0.263174742f, 0.267358094f, 0.271577448f, 0.275832862f, 0.280124396f,
+	0.284452081f, 0.288816005f, 0.293216169f, 0.297652662f, 0.302125514f, 0.306634784f, 0.311180532f, 0.315762758f,
+	0.320381582f, 0.325036973f, 0.32972905f, 0.334457815f, 0.339223355f, 0.344025671f, 0.348864853f, 0.353740931f,
+	0.358653933f, 0.36360392f, 0.368590951f, 0.373615056f, 0.378676265f, 0.383774668f, 0.388910264f, 0.394083142f,
+	0.399293333f, 0.404540837f, 0.409825772f, 0.415148109f, 0.420507938f, 0.425905317f, 0.431340218f, 0.436812758f,
+	0.442322969f, 0.447870851f, 0.453456491f, 0.459079921f, 0.464741141f, 0.470440269f, 0.476177275f, 0.48195225f,
+	0.487765223f, 0.493616223f, 0.499505281f, 0.505432487f, 0.511397839f, 0.517401397f, 0.523443162f, 0.529523253f,
+	0.535641611f, 0.541798353f, 0.547993541f, 0.554227114f, 0.560499191f, 0.566809773f, 0.57315886f, 0.57954663f,
+	0.585973024f, 0.592438042f, 0.598941803f, 0.605484307f, 0.612065613f, 0.618685722f, 0.625344753f, 0.632042646f,
+	0.638779461f, 0.645555258f, 0.652370095f, 0.659224033f, 0.666116953f, 0.673049092f, 0.680020332f, 0.687030852f,
+	0.694080532f, 0.701169491f, 0.708297789f, 0.715465426f, 0.722672462f, 0.729918897f, 0.73720479f, 0.744530201f,
+	0.75189507f, 0.759299576f, 0.7667436f, 0.774227321f, 0.781750679f, 0.789313734f, 0.796916544f, 0.804559112f,
+	0.812241495f, 0.819963694f, 0.827725828f, 0.835527778f, 0.843369722f, 0.851251662f, 0.859173596f, 0.867135525f,
+	0.875137568f, 0.883179724f, 0.891262054f, 0.899384499f, 0.907547176f, 0.915750146f, 0.923993349f, 0.932276845f,
+	0.940600693f, 0.948964953f, 0.957369566f, 0.96581465f, 0.974300206f, 0.982826233f, 0.991392851f, 1.0f
+};
+
+static void stbi__build_l2h_table(void)
+{
+	int i;
+	for (i = 0; i < 256; ++i)
+		stbi__l2h_table[i] = (float)(pow(i / 255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+}
+
+STBIDEF void   stbi_ldr_to_hdr_gamma(float gamma) { stbi__l2h_gamma = gamma; stbi__build_l2h_table(); }
+STBIDEF void   stbi_ldr_to_hdr_scale(float scale) { stbi__l2h_scale = scale; stbi__build_l2h_table(); }
+#endif
+
+static float stbi__h2l_gamma_i = 1.0f / 2.2f, stbi__h2l_scale_i = 1.0f;
+
+STBIDEF void   stbi_hdr_to_ldr_gamma(float gamma) { stbi__h2l_gamma_i = 1 / gamma; }
+STBIDEF void   stbi_hdr_to_ldr_scale(float scale) { stbi__h2l_scale_i = 1 / scale; }
+
+
+//////////////////////////////////////////////////////////////////////////////
+//
+// Common code used by all image loaders
+//
+
+enum
+{
+	STBI__SCAN_load = 0,
+	STBI__SCAN_type,
+	STBI__SCAN_header
+};
+
+static void stbi__refill_buffer(stbi__context* s)
+{
+	int n = (s->io.read)(s->io_user_data, (char*)s->buffer, s->buflen);
+	STBI__STATS_COUNT(refills, 1);
+	STBI__STATS_COUNT(bytes_consumed, n > 0 ? n : 0); // less what's left over, see stbi__load_main
+	if (n == 0) {
+		// at end of file, treat same as if from memory, but need to handle case
+		// where s->img_buffer isn't pointing to safe memory, e.g. 0-byte file
+		s->read_from_callbacks = 0;
+		s->img_buffer = s->buffer;
+		s->img_buffer_end = s->buffer + 1;
+		*s->img_buffer = 0;
+	}
+	else {
+		s->img_buffer = s->buffer;
+		s->img_buffer_end = s->buffer + n;
+	}
+}
+
+stbi_inline static stbi_uc stbi__get8(stbi__context* s)
 {
 	if (s->img_buffer < s->img_buffer_end)
 		return *s->img_buffer++;
@@ -1501,6 +2733,7 @@ static void stbi__skip(stbi__context* s, int n)
 		if (blen < n) {
 			s->img_buffer = s->img_buffer_end;
 			(s->io.skip)(s->io_user_data, n - blen);
+			STBI__STATS_COUNT(bytes_consumed, n - blen);
 			return;
 		}
 	}
@@ -1512,14 +2745,36 @@ static int stbi__getn(stbi__context* s, stbi_uc* buffer, int n)
 	if (s->io.read) {
 		int blen = (int)(s->img_buffer_end - s->img_buffer);
 		if (blen < n) {
-			int res, count;
-
 			memcpy(buffer, s->img_buffer, blen);
-
-			count = (s->io.read)(s->io_user_data, (char*)buffer + blen, n - blen);
-			res = (count == (n - blen));
 			s->img_buffer = s->img_buffer_end;
-			return res;
+			buffer += blen;
+			n -= blen;
+
+			// anything a refill couldn't hold goes straight to the destination;
+			// short tails go through the buffer so what follows is read along
+			// with them. sources may return less than asked, so keep reading
+			while (n > 0) {
+				if (n >= s->buflen) {
+					int count = (s->io.read)(s->io_user_data, (char*)buffer, n);
+					STBI__STATS_COUNT(refills, 1);
+					if (count <= 0) return 0;
+					STBI__STATS_COUNT(bytes_consumed, count);
+					buffer += count;
+					n -= count;
+				}
+				else {
+					if (!s->read_from_callbacks) return 0;
+					stbi__refill_buffer(s);
+					if (!s->read_from_callbacks) return 0;
+					blen = (int)(s->img_buffer_end - s->img_buffer);
+					if (blen > n) blen = n;
+					memcpy(buffer, s->img_buffer, blen);
+					s->img_buffer += blen;
+					buffer += blen;
+					n -= blen;
+				}
+			}
+			return 1;
 		}
 	}
 
@@ -1581,9 +2836,189 @@ static stbi_uc stbi__compute_y(int r, int g, int b)
 	return (stbi_uc)(((r * 77) + (g * 150) + (29 * b)) >> 8);
 }
 
-static unsigned char* stbi__convert_format(unsigned char* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+#ifdef STBI_SSE2
+// 4 RGB pixels from 'src' as RGBA in 32-bit lanes, alpha 255; reads 16 bytes
+static __m128i stbi__load_rgb4_sse2(stbi_uc const* src)
 {
-	int i, j;
+	__m128i v = _mm_loadu_si128((__m128i const*) src);
+	__m128i ab = _mm_unpacklo_epi32(v, _mm_srli_si128(v, 3));
+	__m128i cd = _mm_unpacklo_epi32(_mm_srli_si128(v, 6), _mm_srli_si128(v, 9));
+	return _mm_or_si128(_mm_unpacklo_epi64(ab, cd), _mm_set1_epi32((int)0xff000000));
+}
+
+// the reverse: RGB of 4 pixels in the low 12 bytes
+static __m128i stbi__pack_rgb4_sse2(__m128i v)
+{
+	__m128i t = _mm_and_si128(v, _mm_set1_epi32(0x00ffffff));
+	__m128i w = _mm_or_si128(_mm_and_si128(t, _mm_set_epi32(0, 0x00ffffff, 0, 0x00ffffff)), _mm_slli_epi64(_mm_srli_epi64(t, 32), 24));
+	return _mm_or_si128(_mm_move_epi64(w), _mm_slli_si128(_mm_srli_si128(w, 8), 6));
+}
+
+// stbi__compute_y of RGBA lanes, in the low byte of each lane. the sum fits
+// 16 bits, so 16-bit multiplies are exact
+static __m128i stbi__y_sse2(__m128i v)
+{
+	__m128i m = _mm_set1_epi32(0xff);
+	__m128i r = _mm_mullo_epi16(_mm_and_si128(v, m), _mm_set1_epi32(77));
+	__m128i g = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(v, 8), m), _mm_set1_epi32(150));
+	__m128i b = _mm_mullo_epi16(_mm_and_si128(_mm_srli_epi32(v, 16), m), _mm_set1_epi32(29));
+	return _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(r, g), b), 8);
+}
+
+// converts pixels 8 at a time through RGBA lanes (gray loads as g,g,g, whose
+// stbi__compute_y is g again), returning how many were done. 3-component
+// rows are read and written 16 bytes at a time, so the last 2 pixels are
+// left to the caller
+static int stbi__convert_row_sse2(stbi_uc* dest, stbi_uc const* src, int img_n, int req_comp, int x)
+{
+	int i;
+	for (i = 0; i + 10 <= x; i += 8) {
+		stbi_uc const* s = src + i * img_n;
+		stbi_uc* d = dest + i * req_comp;
+		__m128i lo, hi;
+		switch (img_n) {
+		case 1: {
+			__m128i g = _mm_loadl_epi64((__m128i const*) s);
+			__m128i gg = _mm_unpacklo_epi8(g, g);
+			__m128i ga = _mm_unpacklo_epi8(g, _mm_set1_epi8(-1));
+			lo = _mm_unpacklo_epi16(gg, ga);
+			hi = _mm_unpackhi_epi16(gg, ga);
+		} break;
+		case 2: {
+			__m128i v = _mm_loadu_si128((__m128i const*) s);
+			__m128i g = _mm_and_si128(v, _mm_set1_epi16(0xff));
+			__m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+			lo = _mm_unpacklo_epi16(gg, v);
+			hi = _mm_unpackhi_epi16(gg, v);
+		} break;
+		case 3:
+			lo = stbi__load_rgb4_sse2(s);
+			hi = stbi__load_rgb4_sse2(s + 12);
+			break;
+		default:
+			lo = _mm_loadu_si128((__m128i const*) s);
+			hi = _mm_loadu_si128((__m128i const*) (s + 16));
+		}
+		switch (req_comp) {
+		case 1: {
+			__m128i y = _mm_packs_epi32(stbi__y_sse2(lo), stbi__y_sse2(hi));
+			_mm_storel_epi64((__m128i*) d, _mm_packus_epi16(y, y));
+		} break;
+		case 2: {
+			__m128i ylo = _mm_or_si128(stbi__y_sse2(lo), _mm_slli_epi32(_mm_srli_epi32(lo, 24), 8));
+			__m128i yhi = _mm_or_si128(stbi__y_sse2(hi), _mm_slli_epi32(_mm_srli_epi32(hi, 24), 8));
+			// sign-extend so the saturating pack keeps all 16 bits
+			ylo = _mm_srai_epi32(_mm_slli_epi32(ylo, 16), 16);
+			yhi = _mm_srai_epi32(_mm_slli_epi32(yhi, 16), 16);
+			_mm_storeu_si128((__m128i*) d, _mm_packs_epi32(ylo, yhi));
+		} break;
+		case 3:
+			_mm_storeu_si128((__m128i*) d, stbi__pack_rgb4_sse2(lo));
+			_mm_storeu_si128((__m128i*) (d + 12), stbi__pack_rgb4_sse2(hi));
+			break;
+		default:
+			_mm_storeu_si128((__m128i*) d, lo);
+			_mm_storeu_si128((__m128i*) (d + 16), hi);
+		}
+	}
+	return i;
+}
+#endif
+
+#ifdef STBI_NEON
+// same as stbi__convert_row_sse2, with the (de)interleaving loads and stores
+static int stbi__convert_row_neon(stbi_uc* dest, stbi_uc const* src, int img_n, int req_comp, int x)
+{
+	int i;
+	for (i = 0; i + 8 <= x; i += 8) {
+		stbi_uc const* s = src + i * img_n;
+		stbi_uc* d = dest + i * req_comp;
+		uint8x8x4_t p;
+		uint8x8_t y;
+		switch (img_n) {
+		case 1:
+			p.val[0] = p.val[1] = p.val[2] = vld1_u8(s);
+			p.val[3] = vdup_n_u8(255);
+			break;
+		case 2: {
+			uint8x8x2_t v = vld2_u8(s);
+			p.val[0] = p.val[1] = p.val[2] = v.val[0];
+			p.val[3] = v.val[1];
+		} break;
+		case 3: {
+			uint8x8x3_t v = vld3_u8(s);
+			p.val[0] = v.val[0];
+			p.val[1] = v.val[1];
+			p.val[2] = v.val[2];
+			p.val[3] = vdup_n_u8(255);
+		} break;
+		default:
+			p = vld4_u8(s);
+		}
+		y = vshrn_n_u16(vmlal_u8(vmlal_u8(vmull_u8(p.val[0], vdup_n_u8(77)), p.val[1], vdup_n_u8(150)), p.val[2], vdup_n_u8(29)), 8);
+		switch (req_comp) {
+		case 1:
+			vst1_u8(d, y);
+			break;
+		case 2: {
+			uint8x8x2_t v;
+			v.val[0] = y;
+			v.val[1] = p.val[3];
+			vst2_u8(d, v);
+		} break;
+		case 3: {
+			uint8x8x3_t v;
+			v.val[0] = p.val[0];
+			v.val[1] = p.val[1];
+			v.val[2] = p.val[2];
+			vst3_u8(d, v);
+		} break;
+		default:
+			vst4_u8(d, p);
+		}
+	}
+	return i;
+}
+#endif
+
+// convert one row of 'x' pixels with img_n components to req_comp components
+static void stbi__convert_row(unsigned char* dest, unsigned char const* src, int img_n, int req_comp, unsigned int x)
+{
+	int i;
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+#ifdef STBI_SSE2
+	i = stbi__sse2_available() ? stbi__convert_row_sse2(dest, src, img_n, req_comp, (int)x) : 0;
+#else
+	i = stbi__convert_row_neon(dest, src, img_n, req_comp, (int)x);
+#endif
+	src += i * img_n;
+	dest += i * req_comp;
+	x -= i;
+#endif
+#define STBI__COMBO(a,b)  ((a)*8+(b))
+#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+	// avoid switch per pixel, so use switch per scanline and massive macros
+	switch (STBI__COMBO(img_n, req_comp)) {
+		STBI__CASE(1, 2) { dest[0] = src[0]; dest[1] = 255; } break;
+		STBI__CASE(1, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
+		STBI__CASE(1, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 255; } break;
+		STBI__CASE(2, 1) { dest[0] = src[0]; } break;
+		STBI__CASE(2, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
+		STBI__CASE(2, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; } break;
+		STBI__CASE(3, 4) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = 255; } break;
+		STBI__CASE(3, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
+		STBI__CASE(3, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = 255; } break;
+		STBI__CASE(4, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
+		STBI__CASE(4, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = src[3]; } break;
+		STBI__CASE(4, 3) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; } break;
+	default: STBI_ASSERT(0);
+	}
+#undef STBI__CASE
+}
+
+static unsigned char* stbi__convert_format_main(unsigned char* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+	int j;
 	unsigned char* good;
 
 	if (req_comp == img_n) return data;
@@ -1591,48 +3026,285 @@ static unsigned char* stbi__convert_format(unsigned char* data, int img_n, int r
 
 	good = (unsigned char*)stbi__malloc_mad3(req_comp, x, y, 0);
 	if (good == NULL) {
-		STBI_FREE(data);
+		stbi__free(data);
 		return stbi__errpuc("outofmem", "Out of memory");
 	}
 
-	for (j = 0; j < (int)y; ++j) {
-		unsigned char* src = data + j * x * img_n;
-		unsigned char* dest = good + j * x * req_comp;
-
-#define STBI__COMBO(a,b)  ((a)*8+(b))
-#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-		// convert source image with img_n components to one with req_comp components;
-		// avoid switch per pixel, so use switch per scanline and massive macros
-		switch (STBI__COMBO(img_n, req_comp)) {
-			STBI__CASE(1, 2) { dest[0] = src[0]; dest[1] = 255; } break;
-			STBI__CASE(1, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
-			STBI__CASE(1, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 255; } break;
-			STBI__CASE(2, 1) { dest[0] = src[0]; } break;
-			STBI__CASE(2, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
-			STBI__CASE(2, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; } break;
-			STBI__CASE(3, 4) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = 255; } break;
-			STBI__CASE(3, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
-			STBI__CASE(3, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = 255; } break;
-			STBI__CASE(4, 1) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); } break;
-			STBI__CASE(4, 2) { dest[0] = stbi__compute_y(src[0], src[1], src[2]); dest[1] = src[3]; } break;
-			STBI__CASE(4, 3) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; } break;
-		default: STBI_ASSERT(0);
-		}
-#undef STBI__CASE
-	}
+	// convert source image with img_n components to one with req_comp components
+	for (j = 0; j < (int)y; ++j)
+		stbi__convert_row(good + j * x * req_comp, data + j * x * img_n, img_n, req_comp, x);
 
-	STBI_FREE(data);
+	stbi__free(data);
 	return good;
 }
 
+static unsigned char* stbi__convert_format(unsigned char* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+	unsigned char* result;
+	STBI__STATS_TIME(convert_ns, result = stbi__convert_format_main(data, img_n, req_comp, x, y));
+	return result;
+}
+
+#if defined(STBI_NO_JPEG) && defined(STBI_NO_BMP) && defined(STBI_NO_HDR) && defined(STBI_NO_PNM)
+// nothing
+#else
+// decoders that finish rows in order can stream them to a stbi_stream sink
+// instead of building the image. once the size is known they call
+// stbi__stream_start (with 'n' channels per row, and 'reverse' if their row j
+// is the image's row y-1-j), then write each row to stbi__stream_row and
+// pass it on with stbi__stream_put. the band returned by the start stands in
+// for the output buffer: return it from the load, and never free it
+static stbi_uc* stbi__stream_start(stbi__context* s, int n, int reverse)
+{
+	stbi__stream* st = s->stream;
+	st->x = s->img_x;
+	st->y = s->img_y;
+	st->n_in = n;
+	st->n_out = st->req_comp ? st->req_comp : n;
+	st->reverse = reverse;
+	st->next = 0;
+	// one byte of slack as decoders may write a throwaway byte past a row
+	st->band = (stbi_uc*)stbi__malloc_mad3(st->band_rows, st->x, st->n_out, 1);
+	if (st->n_in != st->n_out)
+		st->scratch = (stbi_uc*)stbi__malloc_mad2(st->x, st->n_in, 1);
+	if (!st->band || (st->n_in != st->n_out && !st->scratch))
+		return NULL; // stbi__stream_main frees whatever was allocated
+	return st->band;
+}
+
+// band slot for the row being produced; *first and *count are the decoder's
+// rows that go in the current band
+static stbi_uc* stbi__stream_slot(stbi__stream* st, int* first, int* count)
+{
+	int slot;
+	*first = st->next - st->next % st->band_rows;
+	*count = st->y - *first < st->band_rows ? st->y - *first : st->band_rows;
+	slot = st->next - *first;
+	if (st->reverse) slot = *count - 1 - slot;
+	return st->band + (size_t)slot * st->x * st->n_out;
+}
+
+// where the decoder writes its next row
+static stbi_uc* stbi__stream_row(stbi__context* s)
+{
+	stbi__stream* st = s->stream;
+	int first, count;
+	if (st->n_in != st->n_out) return st->scratch;
+	return stbi__stream_slot(st, &first, &count);
+}
+
+// hands on the row just written; returns 0 if the sink stopped the load
+static int stbi__stream_put(stbi__context* s)
+{
+	stbi__stream* st = s->stream;
+	int first, count;
+	stbi_uc* slot = stbi__stream_slot(st, &first, &count);
+	if (st->n_in != st->n_out)
+		stbi__convert_row(slot, st->scratch, st->n_in, st->n_out, st->x);
+	if (++st->next - first < count)
+		return 1;
+	if (!st->sink(st->user, st->band, st->reverse ? st->y - first - count : first, count, st->x, st->n_out))
+		return stbi__err("aborted", "Row sink stopped the load");
+	return 1;
+}
+#endif
+
+#if defined(STBI_NO_BMP) && defined(STBI_NO_HDR)
+// nothing
+#else
+// frees a decoder's output buffer, unless it is memory the load was given:
+// a stbi_stream band or the stbi_load_into target
+static void stbi__free_rows(stbi__context* s, void* p)
+{
+	if (p != s->target && !(s->stream && p == s->stream->band))
+		stbi__free(p);
+}
+#endif
+
 static stbi__uint16 stbi__compute_y_16(int r, int g, int b)
 {
 	return (stbi__uint16)(((r * 77) + (g * 150) + (29 * b)) >> 8);
 }
 
-static stbi__uint16* stbi__convert_format16(stbi__uint16* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+#ifdef STBI_SSE2
+// stbi__compute_y_16 of the two RGBA pixels in 'v', in 32-bit lanes 0 and 2.
+// madd is signed, so the samples are biased by -32768 and the sum unbiased
+static __m128i stbi__y16_sse2(__m128i v)
+{
+	__m128i m = _mm_madd_epi16(_mm_xor_si128(v, _mm_set1_epi16((short)0x8000)), _mm_set_epi16(0, 29, 150, 77, 0, 29, 150, 77));
+	m = _mm_add_epi32(m, _mm_srli_epi64(m, 32));
+	return _mm_srli_epi32(_mm_add_epi32(m, _mm_set1_epi32(256 * 32768)), 8);
+}
+
+// 32-bit lanes 0 and 2 of 'a', then of 'b'
+static __m128i stbi__even_lanes_sse2(__m128i a, __m128i b)
+{
+	return _mm_unpacklo_epi64(_mm_shuffle_epi32(a, _MM_SHUFFLE(3, 1, 2, 0)), _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 1, 2, 0)));
+}
+
+// as stbi__convert_row_sse2, with two RGBA pixels per register; 3-component
+// rows are read and written 8 bytes a pixel, so the last pixel is left over
+static int stbi__convert_row16_sse2(stbi__uint16* dest, stbi__uint16 const* src, int img_n, int req_comp, int x)
+{
+	int i, k;
+	for (i = 0; i + 9 <= x; i += 8) {
+		stbi__uint16 const* s = src + i * img_n;
+		stbi__uint16* d = dest + i * req_comp;
+		__m128i p[4];
+		switch (img_n) {
+		case 1: {
+			__m128i v = _mm_loadu_si128((__m128i const*) s);
+			__m128i ones = _mm_set1_epi16(-1);
+			__m128i gg = _mm_unpacklo_epi16(v, v), ga = _mm_unpacklo_epi16(v, ones);
+			p[0] = _mm_unpacklo_epi32(gg, ga);
+			p[1] = _mm_unpackhi_epi32(gg, ga);
+			gg = _mm_unpackhi_epi16(v, v);
+			ga = _mm_unpackhi_epi16(v, ones);
+			p[2] = _mm_unpacklo_epi32(gg, ga);
+			p[3] = _mm_unpackhi_epi32(gg, ga);
+		} break;
+		case 2:
+			for (k = 0; k < 2; ++k) {
+				__m128i v = _mm_loadu_si128((__m128i const*) (s + k * 8));
+				__m128i gg = _mm_or_si128(_mm_and_si128(v, _mm_set1_epi32(0xffff)), _mm_slli_epi32(v, 16));
+				p[k * 2] = _mm_unpacklo_epi32(gg, v);
+				p[k * 2 + 1] = _mm_unpackhi_epi32(gg, v);
+			}
+			break;
+		case 3:
+			for (k = 0; k < 4; ++k)
+				p[k] = _mm_or_si128(_mm_unpacklo_epi64(_mm_loadl_epi64((__m128i const*) (s + k * 6)), _mm_loadl_epi64((__m128i const*) (s + k * 6 + 3))),
+					_mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0));
+			break;
+		default:
+			for (k = 0; k < 4; ++k)
+				p[k] = _mm_loadu_si128((__m128i const*) (s + k * 8));
+		}
+		switch (req_comp) {
+		case 1: {
+			__m128i lo = stbi__even_lanes_sse2(stbi__y16_sse2(p[0]), stbi__y16_sse2(p[1]));
+			__m128i hi = stbi__even_lanes_sse2(stbi__y16_sse2(p[2]), stbi__y16_sse2(p[3]));
+			// sign-extend so the saturating pack keeps all 16 bits
+			lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+			hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+			_mm_storeu_si128((__m128i*) d, _mm_packs_epi32(lo, hi));
+		} break;
+		case 2:
+			for (k = 0; k < 4; ++k)
+				p[k] = _mm_or_si128(stbi__y16_sse2(p[k]), _mm_slli_epi32(_mm_srli_epi64(p[k], 48), 16));
+			_mm_storeu_si128((__m128i*) d, stbi__even_lanes_sse2(p[0], p[1]));
+			_mm_storeu_si128((__m128i*) (d + 8), stbi__even_lanes_sse2(p[2], p[3]));
+			break;
+		case 3:
+			for (k = 0; k < 4; ++k) {
+				_mm_storel_epi64((__m128i*) (d + k * 6), p[k]);
+				_mm_storel_epi64((__m128i*) (d + k * 6 + 3), _mm_srli_si128(p[k], 8));
+			}
+			break;
+		default:
+			for (k = 0; k < 4; ++k)
+				_mm_storeu_si128((__m128i*) (d + k * 8), p[k]);
+		}
+	}
+	return i;
+}
+#endif
+
+#ifdef STBI_NEON
+static int stbi__convert_row16_neon(stbi__uint16* dest, stbi__uint16 const* src, int img_n, int req_comp, int x)
 {
-	int i, j;
+	int i;
+	for (i = 0; i + 8 <= x; i += 8) {
+		stbi__uint16 const* s = src + i * img_n;
+		stbi__uint16* d = dest + i * req_comp;
+		uint16x8x4_t p;
+		uint32x4_t lo, hi;
+		uint16x8_t y;
+		switch (img_n) {
+		case 1:
+			p.val[0] = p.val[1] = p.val[2] = vld1q_u16(s);
+			p.val[3] = vdupq_n_u16(0xffff);
+			break;
+		case 2: {
+			uint16x8x2_t v = vld2q_u16(s);
+			p.val[0] = p.val[1] = p.val[2] = v.val[0];
+			p.val[3] = v.val[1];
+		} break;
+		case 3: {
+			uint16x8x3_t v = vld3q_u16(s);
+			p.val[0] = v.val[0];
+			p.val[1] = v.val[1];
+			p.val[2] = v.val[2];
+			p.val[3] = vdupq_n_u16(0xffff);
+		} break;
+		default:
+			p = vld4q_u16(s);
+		}
+		lo = vmlal_u16(vmlal_u16(vmull_u16(vget_low_u16(p.val[0]), vdup_n_u16(77)), vget_low_u16(p.val[1]), vdup_n_u16(150)), vget_low_u16(p.val[2]), vdup_n_u16(29));
+		hi = vmlal_u16(vmlal_u16(vmull_u16(vget_high_u16(p.val[0]), vdup_n_u16(77)), vget_high_u16(p.val[1]), vdup_n_u16(150)), vget_high_u16(p.val[2]), vdup_n_u16(29));
+		y = vcombine_u16(vshrn_n_u32(lo, 8), vshrn_n_u32(hi, 8));
+		switch (req_comp) {
+		case 1:
+			vst1q_u16(d, y);
+			break;
+		case 2: {
+			uint16x8x2_t v;
+			v.val[0] = y;
+			v.val[1] = p.val[3];
+			vst2q_u16(d, v);
+		} break;
+		case 3: {
+			uint16x8x3_t v;
+			v.val[0] = p.val[0];
+			v.val[1] = p.val[1];
+			v.val[2] = p.val[2];
+			vst3q_u16(d, v);
+		} break;
+		default:
+			vst4q_u16(d, p);
+		}
+	}
+	return i;
+}
+#endif
+
+static void stbi__convert_row16(stbi__uint16* dest, stbi__uint16 const* src, int img_n, int req_comp, unsigned int x)
+{
+	int i;
+#if defined(STBI_SSE2) || defined(STBI_NEON)
+#ifdef STBI_SSE2
+	i = stbi__sse2_available() ? stbi__convert_row16_sse2(dest, src, img_n, req_comp, (int)x) : 0;
+#else
+	i = stbi__convert_row16_neon(dest, src, img_n, req_comp, (int)x);
+#endif
+	src += i * img_n;
+	dest += i * req_comp;
+	x -= i;
+#endif
+#define STBI__COMBO(a,b)  ((a)*8+(b))
+#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
+	// avoid switch per pixel, so use switch per scanline and massive macros
+	switch (STBI__COMBO(img_n, req_comp)) {
+		STBI__CASE(1, 2) { dest[0] = src[0]; dest[1] = 0xffff; } break;
+		STBI__CASE(1, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
+		STBI__CASE(1, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 0xffff; } break;
+		STBI__CASE(2, 1) { dest[0] = src[0]; } break;
+		STBI__CASE(2, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
+		STBI__CASE(2, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; } break;
+		STBI__CASE(3, 4) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = 0xffff; } break;
+		STBI__CASE(3, 1) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); } break;
+		STBI__CASE(3, 2) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); dest[1] = 0xffff; } break;
+		STBI__CASE(4, 1) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); } break;
+		STBI__CASE(4, 2) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); dest[1] = src[3]; } break;
+		STBI__CASE(4, 3) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; } break;
+	default: STBI_ASSERT(0);
+	}
+#undef STBI__CASE
+}
+
+static stbi__uint16* stbi__convert_format16_main(stbi__uint16* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+	int j;
 	stbi__uint16* good;
 
 	if (req_comp == img_n) return data;
@@ -1640,40 +3312,25 @@ static stbi__uint16* stbi__convert_format16(stbi__uint16* data, int img_n, int r
 
 	good = (stbi__uint16*)stbi__malloc(req_comp * x * y * 2);
 	if (good == NULL) {
-		STBI_FREE(data);
+		stbi__free(data);
 		return (stbi__uint16*)stbi__errpuc("outofmem", "Out of memory");
 	}
 
-	for (j = 0; j < (int)y; ++j) {
-		stbi__uint16* src = data + j * x * img_n;
-		stbi__uint16* dest = good + j * x * req_comp;
-
-#define STBI__COMBO(a,b)  ((a)*8+(b))
-#define STBI__CASE(a,b)   case STBI__COMBO(a,b): for(i=x-1; i >= 0; --i, src += a, dest += b)
-		// convert source image with img_n components to one with req_comp components;
-		// avoid switch per pixel, so use switch per scanline and massive macros
-		switch (STBI__COMBO(img_n, req_comp)) {
-			STBI__CASE(1, 2) { dest[0] = src[0]; dest[1] = 0xffff; } break;
-			STBI__CASE(1, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
-			STBI__CASE(1, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = 0xffff; } break;
-			STBI__CASE(2, 1) { dest[0] = src[0]; } break;
-			STBI__CASE(2, 3) { dest[0] = dest[1] = dest[2] = src[0]; } break;
-			STBI__CASE(2, 4) { dest[0] = dest[1] = dest[2] = src[0]; dest[3] = src[1]; } break;
-			STBI__CASE(3, 4) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; dest[3] = 0xffff; } break;
-			STBI__CASE(3, 1) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); } break;
-			STBI__CASE(3, 2) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); dest[1] = 0xffff; } break;
-			STBI__CASE(4, 1) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); } break;
-			STBI__CASE(4, 2) { dest[0] = stbi__compute_y_16(src[0], src[1], src[2]); dest[1] = src[3]; } break;
-			STBI__CASE(4, 3) { dest[0] = src[0]; dest[1] = src[1]; dest[2] = src[2]; } break;
-		default: STBI_ASSERT(0);
-		}
-#undef STBI__CASE
-	}
+	// convert source image with img_n components to one with req_comp components
+	for (j = 0; j < (int)y; ++j)
+		stbi__convert_row16(good + j * x * req_comp, data + j * x * img_n, img_n, req_comp, x);
 
-	STBI_FREE(data);
+	stbi__free(data);
 	return good;
 }
 
+static stbi__uint16* stbi__convert_format16(stbi__uint16* data, int img_n, int req_comp, unsigned int x, unsigned int y)
+{
+	stbi__uint16* result;
+	STBI__STATS_TIME(convert_ns, result = stbi__convert_format16_main(data, img_n, req_comp, x, y));
+	return result;
+}
+
 #ifndef STBI_NO_LINEAR
 static float* stbi__ldr_to_hdr(stbi_uc* data, int x, int y, int comp)
 {
@@ -1681,12 +3338,12 @@ static float* stbi__ldr_to_hdr(stbi_uc* data, int x, int y, int comp)
 	float* output;
 	if (!data) return NULL;
 	output = (float*)stbi__malloc_mad4(x, y, comp, sizeof(float), 0);
-	if (output == NULL) { STBI_FREE(data); return stbi__errpf("outofmem", "Out of memory"); }
+	if (output == NULL) { stbi__free(data); return stbi__errpf("outofmem", "Out of memory"); }
 	// compute number of non-alpha components
 	if (comp & 1) n = comp; else n = comp - 1;
 	for (i = 0; i < x * y; ++i) {
 		for (k = 0; k < n; ++k) {
-			output[i * comp + k] = (float)(pow(data[i * comp + k] / 255.0f, stbi__l2h_gamma) * stbi__l2h_scale);
+			output[i * comp + k] = stbi__l2h_table[data[i * comp + k]];
 		}
 	}
 	if (n < comp) {
@@ -1694,37 +3351,127 @@ static float* stbi__ldr_to_hdr(stbi_uc* data, int x, int y, int comp)
 			output[i * comp + n] = data[i * comp + n] / 255.0f;
 		}
 	}
-	STBI_FREE(data);
+	stbi__free(data);
 	return output;
 }
 #endif
 
 #ifndef STBI_NO_HDR
 #define stbi__float2int(x)   ((int) (x))
+static stbi_uc stbi__hdr_to_ldr_value(float v, int is_alpha)
+{
+	float z = is_alpha ? v * 255 + 0.5f : (float)pow(v * stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
+	if (z < 0) z = 0;
+	if (z > 255) z = 255;
+	return (stbi_uc)stbi__float2int(z);
+}
+
+#ifdef STBI_SSE2
+// log2(x) for positive normal x: split off the exponent with the mantissa in
+// [sqrt(1/2),sqrt(2)), then the atanh series in t=(m-1)/(m+1), |t| < 0.172.
+// truncation error is below 1e-8
+static __m128 stbi__log2_sse2(__m128 x)
+{
+	__m128i xi = _mm_castps_si128(x);
+	__m128i e = _mm_sub_epi32(_mm_srli_epi32(xi, 23), _mm_set1_epi32(127));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(xi, _mm_set1_epi32(0x007fffff)), _mm_set1_epi32(0x3f800000)));
+	__m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+	__m128 t, t2, p;
+	m = _mm_sub_ps(m, _mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+	e = _mm_sub_epi32(e, _mm_castps_si128(big)); // mask is -1 where halved
+	t = _mm_div_ps(_mm_sub_ps(m, _mm_set1_ps(1.0f)), _mm_add_ps(m, _mm_set1_ps(1.0f)));
+	t2 = _mm_mul_ps(t, t);
+	p = _mm_add_ps(_mm_set1_ps(0.4121985831f), _mm_mul_ps(t2, _mm_set1_ps(0.3205988980f)));
+	p = _mm_add_ps(_mm_set1_ps(0.5770780164f), _mm_mul_ps(t2, p));
+	p = _mm_add_ps(_mm_set1_ps(0.9617966939f), _mm_mul_ps(t2, p));
+	p = _mm_add_ps(_mm_set1_ps(2.8853900818f), _mm_mul_ps(t2, p));
+	return _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(t, p));
+}
+
+// 2^y for y in [-126,9]: integer part into the exponent, degree-6 Taylor
+// series for the fraction in [-0.5,0.5] (relative error below 2e-7)
+static __m128 stbi__exp2_sse2(__m128 y)
+{
+	__m128i n = _mm_cvtps_epi32(y);
+	__m128 f = _mm_sub_ps(y, _mm_cvtepi32_ps(n));
+	__m128 p = _mm_add_ps(_mm_set1_ps(1.3333558146e-3f), _mm_mul_ps(f, _mm_set1_ps(1.5403530393e-4f)));
+	p = _mm_add_ps(_mm_set1_ps(9.6181291076e-3f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(5.5504108665e-2f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(2.4022650696e-1f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(6.9314718056e-1f), _mm_mul_ps(f, p));
+	p = _mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(f, p));
+	return _mm_mul_ps(p, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)));
+}
+
+// converts 'count' floats, four at a time, returning how many were done. the
+// pow() approximation is good to about 1e-6 relative, far inside the 0.5/255
+// it would take to move a result by more than one step, so for the
+// non-negative values the HDR decoder produces every output is within 1 of
+// the scalar path's (and almost always identical)
+static int stbi__hdr_to_ldr_sse2(stbi_uc* output, float* data, int count, int comp)
+{
+	int i, j;
+	__m128 scale = _mm_set1_ps(stbi__h2l_scale_i);
+	__m128 gamma = _mm_set1_ps(stbi__h2l_gamma_i);
+	__m128 zero = _mm_setzero_ps(), half = _mm_set1_ps(0.5f), c255 = _mm_set1_ps(255.0f);
+	__m128 min_normal = _mm_set1_ps(1.17549435e-38f);
+	// alpha lanes; 4 floats always start on a pixel boundary for 1, 2 or 4 components
+	__m128 is_alpha = _mm_castsi128_ps(comp == 2 ? _mm_set_epi32(-1, 0, -1, 0) : comp == 4 ? _mm_set_epi32(-1, 0, 0, 0) : _mm_setzero_si128());
+	for (i = 0; i + 4 <= count; i += 4) {
+		__m128 v = _mm_loadu_ps(data + i);
+		__m128 c = _mm_mul_ps(v, scale);
+		__m128 a = _mm_add_ps(_mm_mul_ps(v, c255), half);
+		__m128 z;
+		__m128i r;
+		// zero and NaN give 0 as in the scalar path; denormals need the exact
+		// pow for extreme gammas
+		__m128 pos = _mm_cmpgt_ps(c, zero);
+		if (_mm_movemask_ps(_mm_andnot_ps(is_alpha, _mm_and_ps(pos, _mm_cmplt_ps(c, min_normal))))) {
+			for (j = 0; j < 4; ++j)
+				output[i + j] = stbi__hdr_to_ldr_value(data[i + j], (comp & 1) == 0 && (i + j) % comp == comp - 1);
+			continue;
+		}
+		c = _mm_max_ps(c, min_normal);
+		z = stbi__exp2_sse2(_mm_min_ps(_mm_max_ps(_mm_mul_ps(gamma, stbi__log2_sse2(c)), _mm_set1_ps(-126.0f)), _mm_set1_ps(9.0f)));
+		z = _mm_and_ps(pos, _mm_add_ps(_mm_mul_ps(z, c255), half));
+		z = _mm_or_ps(_mm_and_ps(is_alpha, a), _mm_andnot_ps(is_alpha, z));
+		// clamp; max/min with the constant second also turn NaN into 255/0 as in the
+		// scalar path, and the alpha NaN case is then masked back to 0 by cmpord
+		z = _mm_and_ps(_mm_cmpord_ps(z, z), _mm_min_ps(_mm_max_ps(z, zero), c255));
+		r = _mm_cvttps_epi32(z);
+		r = _mm_packs_epi32(r, r);
+		r = _mm_packus_epi16(r, r);
+		*(int*)(output + i) = _mm_cvtsi128_si32(r);
+	}
+	return i;
+}
+#endif
+
 static stbi_uc* stbi__hdr_to_ldr(float* data, int x, int y, int comp)
 {
-	int i, k, n;
+	int i = 0, k, n;
 	stbi_uc* output;
 	if (!data) return NULL;
 	output = (stbi_uc*)stbi__malloc_mad3(x, y, comp, 0);
-	if (output == NULL) { STBI_FREE(data); return stbi__errpuc("outofmem", "Out of memory"); }
+	if (output == NULL) { stbi__free(data); return stbi__errpuc("outofmem", "Out of memory"); }
 	// compute number of non-alpha components
 	if (comp & 1) n = comp; else n = comp - 1;
-	for (i = 0; i < x * y; ++i) {
-		for (k = 0; k < n; ++k) {
-			float z = (float)pow(data[i * comp + k] * stbi__h2l_scale_i, stbi__h2l_gamma_i) * 255 + 0.5f;
-			if (z < 0) z = 0;
-			if (z > 255) z = 255;
-			output[i * comp + k] = (stbi_uc)stbi__float2int(z);
-		}
-		if (k < comp) {
-			float z = data[i * comp + k] * 255 + 0.5f;
-			if (z < 0) z = 0;
-			if (z > 255) z = 255;
-			output[i * comp + k] = (stbi_uc)stbi__float2int(z);
-		}
+#ifdef STBI_SSE2
+	// comp 3 has no alpha, so any 4-float group works; otherwise groups are whole pixels
+	if (stbi__h2l_gamma_i > 0 && stbi__sse2_available()) {
+		i = stbi__hdr_to_ldr_sse2(output, data, x * y * comp, comp);
+		for (; i % comp; ++i)
+			output[i] = stbi__hdr_to_ldr_value(data[i], 0);
+		i /= comp;
+	}
+#endif
+	for (; i < x * y; ++i) {
+		for (k = 0; k < n; ++k)
+			output[i * comp + k] = stbi__hdr_to_ldr_value(data[i * comp + k], 0);
+		if (k < comp)
+			output[i * comp + k] = stbi__hdr_to_ldr_value(data[i * comp + k], 1);
 	}
-	STBI_FREE(data);
+	stbi__free(data);
 	return output;
 }
 #endif
@@ -1930,6 +3677,7 @@ stbi_inline static int stbi__jpeg_huff_decode(stbi__jpeg* j, stbi__huffman* h)
 		j->code_bits -= s;
 		return h->values[k];
 	}
+	STBI__STATS_COUNT(jpeg_huff_slow, 1);
 
 	// naive test is to shift the code_buffer down so k bits are
 	// valid, then test against maxcode. To speed this up, we've
@@ -2781,7 +4529,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
 				for (i = 0; i < w; ++i) {
 					int ha = z->img_comp[n].ha;
 					if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-					z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
+					STBI__STATS_TIME(idct_ns, z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data));
 					// every data block is an MCU, so countdown the restart interval
 					if (--z->todo <= 0) {
 						if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
@@ -2810,7 +4558,7 @@ static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
 								int y2 = (j * z->img_comp[n].v + y) * 8;
 								int ha = z->img_comp[n].ha;
 								if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-								z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data);
+								STBI__STATS_TIME(idct_ns, z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data));
 							}
 						}
 					}
@@ -3067,17 +4815,17 @@ static int stbi__free_jpeg_components(stbi__jpeg* z, int ncomp, int why)
 	int i;
 	for (i = 0; i < ncomp; ++i) {
 		if (z->img_comp[i].raw_data) {
-			STBI_FREE(z->img_comp[i].raw_data);
+			stbi__free(z->img_comp[i].raw_data);
 			z->img_comp[i].raw_data = NULL;
 			z->img_comp[i].data = NULL;
 		}
 		if (z->img_comp[i].raw_coeff) {
-			STBI_FREE(z->img_comp[i].raw_coeff);
+			stbi__free(z->img_comp[i].raw_coeff);
 			z->img_comp[i].raw_coeff = 0;
 			z->img_comp[i].coeff = 0;
 		}
 		if (z->img_comp[i].linebuf) {
-			STBI_FREE(z->img_comp[i].linebuf);
+			stbi__free(z->img_comp[i].linebuf);
 			z->img_comp[i].linebuf = NULL;
 		}
 	}
@@ -3203,7 +4951,7 @@ static int stbi__decode_jpeg_header(stbi__jpeg* z, int scan)
 // decode image to YCbCr format
 static int stbi__decode_jpeg_image(stbi__jpeg* j)
 {
-	int m;
+	int m, ok;
 	for (m = 0; m < 4; m++) {
 		j->img_comp[m].raw_data = NULL;
 		j->img_comp[m].raw_coeff = NULL;
@@ -3214,7 +4962,8 @@ static int stbi__decode_jpeg_image(stbi__jpeg* j)
 	while (!stbi__EOI(m)) {
 		if (stbi__SOS(m)) {
 			if (!stbi__process_scan_header(j)) return 0;
-			if (!stbi__parse_entropy_coded_data(j)) return 0;
+			STBI__STATS_TIME(entropy_ns, ok = stbi__parse_entropy_coded_data(j));
+			if (!ok) return 0;
 			if (j->marker == STBI__MARKER_none) {
 				// handle 0s at the end of image data from IP Kamera 9060
 				while (!stbi__at_eof(j->s)) {
@@ -3239,7 +4988,7 @@ static int stbi__decode_jpeg_image(stbi__jpeg* j)
 		m = stbi__get_marker(j);
 	}
 	if (j->progressive)
-		stbi__jpeg_finish(j);
+		STBI__STATS_TIME(idct_ns, stbi__jpeg_finish(j));
 	return 1;
 }
 
@@ -3684,6 +5433,7 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
 	{
 		int k;
 		unsigned int i, j;
+		size_t pitch;
 		stbi_uc* output;
 		stbi_uc* coutput[4] = { NULL, NULL, NULL, NULL };
 
@@ -3711,13 +5461,23 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
 			else                               r->resample = stbi__resample_row_generic;
 		}
 
-		// can't error after this so, this is safe
-		output = (stbi_uc*)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+		// nothing but a row sink can stop the load after this
+		if (z->s->stream) {
+			output = stbi__stream_start(z->s, n, z->s->flip_vertically);
+			pitch = 0;
+		}
+		else
+			output = stbi__alloc_rows(z->s, n, n == 3, &pitch);
 		if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
 		// now go ahead and resample
 		for (j = 0; j < z->s->img_y; ++j) {
-			stbi_uc* out = output + n * z->s->img_x * j;
+			stbi_uc* out = z->s->stream ? stbi__stream_row(z->s) : output + pitch * stbi__out_row(z->s, j, z->s->img_y);
+			// 3-channel rows write a throwaway 4th byte past their end, which
+			// is the next row down (or padding); keep it intact
+			stbi_uc* row_end = out + n * z->s->img_x;
+			stbi_uc spill = (n == 3) ? *row_end : 0;
+			STBI__STATS_LAP_START();
 			for (k = 0; k < decode_n; ++k) {
 				stbi__resample* r = &res_comp[k];
 				int y_bot = r->ystep >= (r->vs >> 1);
@@ -3732,6 +5492,7 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
 						r->line1 += z->img_comp[k].w2;
 				}
 			}
+			STBI__STATS_LAP(upsample_ns);
 			if (n >= 3) {
 				stbi_uc* y = coutput[0];
 				if (z->s->img_n == 3) {
@@ -3799,14 +5560,14 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
 						stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
 						stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
 						out[0] = stbi__compute_y(r, g, b);
-						out[1] = 255;
+						if (n == 2) out[1] = 255; // grey rows have no room past their end
 						out += n;
 					}
 				}
 				else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
 					for (i = 0; i < z->s->img_x; ++i) {
 						out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-						out[1] = 255;
+						if (n == 2) out[1] = 255;
 						out += n;
 					}
 				}
@@ -3818,6 +5579,9 @@ static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp
 						for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
 				}
 			}
+			if (n == 3) *row_end = spill;
+			STBI__STATS_LAP(color_ns);
+			if (z->s->stream && !stbi__stream_put(z->s)) { stbi__cleanup_jpeg(z); return NULL; }
 		}
 		stbi__cleanup_jpeg(z);
 		*out_x = z->s->img_x;
@@ -3832,10 +5596,11 @@ static void* stbi__jpeg_load(stbi__context* s, int* x, int* y, int* comp, int re
 	unsigned char* result;
 	stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
 	STBI_NOTUSED(ri);
+	if (!j) return stbi__errpuc("outofmem", "Out of memory");
 	j->s = s;
 	stbi__setup_jpeg(j);
 	result = load_jpeg_image(j, x, y, comp, req_comp);
-	STBI_FREE(j);
+	stbi__free(j);
 	return result;
 }
 
@@ -3843,11 +5608,12 @@ static int stbi__jpeg_test(stbi__context* s)
 {
 	int r;
 	stbi__jpeg* j = (stbi__jpeg*)stbi__malloc(sizeof(stbi__jpeg));
+	if (!j) return stbi__err("outofmem", "Out of memory");
 	j->s = s;
 	stbi__setup_jpeg(j);
 	r = stbi__decode_jpeg_header(j, STBI__SCAN_type);
 	stbi__rewind(s);
-	STBI_FREE(j);
+	stbi__free(j);
 	return r;
 }
 
@@ -3867,9 +5633,10 @@ static int stbi__jpeg_info(stbi__context* s, int* x, int* y, int* comp)
 {
 	int result;
 	stbi__jpeg* j = (stbi__jpeg*)(stbi__malloc(sizeof(stbi__jpeg)));
+	if (!j) return stbi__err("outofmem", "Out of memory");
 	j->s = s;
 	result = stbi__jpeg_info_raw(j, x, y, comp);
-	STBI_FREE(j);
+	stbi__free(j);
 	return result;
 }
 #endif
@@ -4011,6 +5778,7 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf* z, int n)
 static int stbi__zhuffman_decode_slowpath(stbi__zbuf* a, stbi__zhuffman* z)
 {
 	int b, s, k;
+	STBI__STATS_COUNT(zlib_slow, 1);
 	// not resolved by fast table, so compute it the slow way
 	// use jpeg approach, which requires MSbits at top
 	k = stbi__bit_reverse(a->code_buffer, 16);
@@ -4050,7 +5818,7 @@ static int stbi__zexpand(stbi__zbuf* z, char* zout, int n)  // need to make room
 	limit = old_limit = (int)(z->zout_end - z->zout_start);
 	while (cur + n > limit)
 		limit *= 2;
-	q = (char*)STBI_REALLOC_SIZED(z->zout_start, old_limit, limit);
+	q = (char*)stbi__realloc_sized(z->zout_start, old_limit, limit);
 	STBI_NOTUSED(old_limit);
 	if (q == NULL) return stbi__err("outofmem", "Out of memory");
 	z->zout_start = q;
@@ -4271,12 +6039,14 @@ static int stbi__parse_zlib(stbi__zbuf* a, int parse_header)
 
 static int stbi__do_zlib(stbi__zbuf* a, char* obuf, int olen, int exp, int parse_header)
 {
+	int ok;
 	a->zout_start = obuf;
 	a->zout = obuf;
 	a->zout_end = obuf + olen;
 	a->z_expandable = exp;
 
-	return stbi__parse_zlib(a, parse_header);
+	STBI__STATS_TIME(inflate_ns, ok = stbi__parse_zlib(a, parse_header));
+	return ok;
 }
 
 STBIDEF char* stbi_zlib_decode_malloc_guesssize(const char* buffer, int len, int initial_size, int* outlen)
@@ -4291,7 +6061,7 @@ STBIDEF char* stbi_zlib_decode_malloc_guesssize(const char* buffer, int len, int
 		return a.zout_start;
 	}
 	else {
-		STBI_FREE(a.zout_start);
+		stbi__free(a.zout_start);
 		return NULL;
 	}
 }
@@ -4313,7 +6083,7 @@ STBIDEF char* stbi_zlib_decode_malloc_guesssize_headerflag(const char* buffer, i
 		return a.zout_start;
 	}
 	else {
-		STBI_FREE(a.zout_start);
+		stbi__free(a.zout_start);
 		return NULL;
 	}
 }
@@ -4341,7 +6111,7 @@ STBIDEF char* stbi_zlib_decode_noheader_malloc(char const* buffer, int len, int*
 		return a.zout_start;
 	}
 	else {
-		STBI_FREE(a.zout_start);
+		stbi__free(a.zout_start);
 		return NULL;
 	}
 }
@@ -4397,6 +6167,8 @@ typedef struct
 	stbi__context* s;
 	stbi_uc* idata, * expanded, * out;
 	int depth;
+	stbi_uc* pal_out;   // if non-NULL, keep palette indices and copy the palette here
+	int pal_len;
 } stbi__png;
 
 
@@ -4434,7 +6206,9 @@ static int stbi__paeth(int a, int b, int c)
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// with 'flip', scanline j is stored as row y-1-j, and the prior scanline used by
+// the filters is the row below instead of the one above
+static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color, int flip)
 {
 	int bytes = (depth == 16 ? 2 : 1);
 	stbi__context* s = a->s;
@@ -4461,7 +6235,8 @@ static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 r
 	if (raw_len < img_len) return stbi__err("not enough pixels", "Corrupt PNG");
 
 	for (j = 0; j < y; ++j) {
-		stbi_uc* cur = a->out + stride * j;
+		stbi__uint32 row = flip ? y - 1 - j : j;
+		stbi_uc* cur = a->out + stride * row;
 		stbi_uc* prior;
 		int filter = *raw++;
 
@@ -4474,7 +6249,7 @@ static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 r
 			filter_bytes = 1;
 			width = img_width_bytes;
 		}
-		prior = cur - stride; // bugfix: need to compute this after 'cur +=' computation above
+		prior = flip ? cur + stride : cur - stride; // bugfix: need to compute this after 'cur +=' computation above
 
 		// if first row, use special filter that doesn't sample previous row
 		if (j == 0) filter = first_row_filter[filter];
@@ -4553,7 +6328,7 @@ static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 r
 			// the loop above sets the high byte of the pixels' alpha, but for
 			// 16 bit png files we also need the low byte set. we'll do that here.
 			if (depth == 16) {
-				cur = a->out + stride * j; // start at the beginning of the row again
+				cur = a->out + stride * row; // start at the beginning of the row again
 				for (i = 0; i < x; ++i, cur += output_bytes) {
 					cur[filter_bytes + 1] = 255;
 				}
@@ -4660,10 +6435,11 @@ static int stbi__create_png_image(stbi__png* a, stbi_uc* image_data, stbi__uint3
 	stbi_uc* final;
 	int p;
 	if (!interlaced)
-		return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color);
+		return stbi__create_png_image_raw(a, image_data, image_data_len, out_n, a->s->img_x, a->s->img_y, depth, color, a->s->flip_vertically);
 
 	// de-interlacing
 	final = (stbi_uc*)stbi__malloc_mad3(a->s->img_x, a->s->img_y, out_bytes, 0);
+	if (!final) return stbi__err("outofmem", "Out of memory");
 	for (p = 0; p < 7; ++p) {
 		int xorig[] = { 0,4,0,2,0,1,0 };
 		int yorig[] = { 0,0,4,0,2,0,1 };
@@ -4675,19 +6451,19 @@ static int stbi__create_png_image(stbi__png* a, stbi_uc* image_data, stbi__uint3
 		y = (a->s->img_y - yorig[p] + yspc[p] - 1) / yspc[p];
 		if (x && y) {
 			stbi__uint32 img_len = ((((a->s->img_n * x * depth) + 7) >> 3) + 1) * y;
-			if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color)) {
-				STBI_FREE(final);
+			if (!stbi__create_png_image_raw(a, image_data, image_data_len, out_n, x, y, depth, color, 0)) {
+				stbi__free(final);
 				return 0;
 			}
 			for (j = 0; j < y; ++j) {
 				for (i = 0; i < x; ++i) {
-					int out_y = j * yspc[p] + yorig[p];
+					int out_y = stbi__out_row(a->s, j * yspc[p] + yorig[p], (int)a->s->img_y);
 					int out_x = i * xspc[p] + xorig[p];
 					memcpy(final + out_y * a->s->img_x * out_bytes + out_x * out_bytes,
 						a->out + (j * x + i) * out_bytes, out_bytes);
 				}
 			}
-			STBI_FREE(a->out);
+			stbi__free(a->out);
 			image_data += img_len;
 			image_data_len -= img_len;
 		}
@@ -4779,7 +6555,7 @@ static int stbi__expand_png_palette(stbi__png* a, stbi_uc* palette, int len, int
 			p += 4;
 		}
 	}
-	STBI_FREE(a->out);
+	stbi__free(a->out);
 	a->out = temp_out;
 
 	STBI_NOTUSED(len);
@@ -4787,9 +6563,6 @@ static int stbi__expand_png_palette(stbi__png* a, stbi_uc* palette, int len, int
 	return 1;
 }
 
-static int stbi__unpremultiply_on_load = 0;
-static int stbi__de_iphone_flag = 0;
-
 STBIDEF void stbi_set_unpremultiply_on_load(int flag_true_if_should_unpremultiply)
 {
 	stbi__unpremultiply_on_load = flag_true_if_should_unpremultiply;
@@ -4816,7 +6589,7 @@ static void stbi__de_iphone(stbi__png* z)
 	}
 	else {
 		STBI_ASSERT(s->img_out_n == 4);
-		if (stbi__unpremultiply_on_load) {
+		if (s->unpremultiply) {
 			// convert bgr to rgb and unpremultiply
 			for (i = 0; i < pixel_count; ++i) {
 				stbi_uc a = p[3];
@@ -4854,7 +6627,7 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
 	stbi_uc has_trans = 0, tc[3] = { 0 };
 	stbi__uint16 tc16[3];
 	stbi__uint32 ioff = 0, idata_limit = 0, i, pal_len = 0;
-	int first = 1, k, interlace = 0, color = 0, is_iphone = 0;
+	int first = 1, k, interlace = 0, color = 0, is_iphone = 0, ok;
 	stbi__context* s = z->s;
 
 	z->expanded = NULL;
@@ -4883,6 +6656,7 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
 			color = stbi__get8(s);  if (color > 6)         return stbi__err("bad ctype", "Corrupt PNG");
 			if (color == 3 && z->depth == 16)                  return stbi__err("bad ctype", "Corrupt PNG");
 			if (color == 3) pal_img_n = 3; else if (color & 1) return stbi__err("bad ctype", "Corrupt PNG");
+			if (z->pal_out && !pal_img_n) return stbi__err("not paletted", "Indexed loading needs a paletted PNG or GIF");
 			comp = stbi__get8(s);  if (comp) return stbi__err("bad comp method", "Corrupt PNG");
 			filter = stbi__get8(s);  if (filter) return stbi__err("bad filter method", "Corrupt PNG");
 			interlace = stbi__get8(s); if (interlace > 1) return stbi__err("bad interlace method", "Corrupt PNG");
@@ -4953,7 +6727,7 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
 				while (ioff + c.length > idata_limit)
 					idata_limit *= 2;
 				STBI_NOTUSED(idata_limit_old);
-				p = (stbi_uc*)STBI_REALLOC_SIZED(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
+				p = (stbi_uc*)stbi__realloc_sized(z->idata, idata_limit_old, idata_limit); if (p == NULL) return stbi__err("outofmem", "Out of memory");
 				z->idata = p;
 			}
 			if (!stbi__getn(s, z->idata + ioff, c.length)) return stbi__err("outofdata", "Corrupt PNG");
@@ -4971,12 +6745,13 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
 			raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
 			z->expanded = (stbi_uc*)stbi_zlib_decode_malloc_guesssize_headerflag((char*)z->idata, ioff, raw_len, (int*)& raw_len, !is_iphone);
 			if (z->expanded == NULL) return 0; // zlib should set error
-			STBI_FREE(z->idata); z->idata = NULL;
+			stbi__free(z->idata); z->idata = NULL;
 			if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
 				s->img_out_n = s->img_n + 1;
 			else
 				s->img_out_n = s->img_n;
-			if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+			STBI__STATS_TIME(defilter_ns, ok = stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace));
+			if (!ok) return 0;
 			if (has_trans) {
 				if (z->depth == 16) {
 					if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
@@ -4985,9 +6760,15 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
 					if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
 				}
 			}
-			if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
+			if (is_iphone && s->de_iphone && s->img_out_n > 2)
 				stbi__de_iphone(z);
-			if (pal_img_n) {
+			if (pal_img_n && z->pal_out) {
+				// indexed output: leave the 8-bit indices alone, hand back the palette
+				s->img_n = pal_img_n;
+				memcpy(z->pal_out, palette, pal_len * 4);
+				z->pal_len = pal_len;
+			}
+			else if (pal_img_n) {
 				// pal_img_n == 3 or 4
 				s->img_n = pal_img_n; // record the actual colors we had
 				s->img_out_n = pal_img_n;
@@ -4999,7 +6780,7 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
 				// non-paletted image with tRNS -> source image has (constant) alpha
 				++s->img_n;
 			}
-			STBI_FREE(z->expanded); z->expanded = NULL;
+			stbi__free(z->expanded); z->expanded = NULL;
 			return 1;
 		}
 
@@ -5048,9 +6829,9 @@ static void* stbi__do_png(stbi__png* p, int* x, int* y, int* n, int req_comp, st
 		*y = p->s->img_y;
 		if (n)* n = p->s->img_n;
 	}
-	STBI_FREE(p->out);      p->out = NULL;
-	STBI_FREE(p->expanded); p->expanded = NULL;
-	STBI_FREE(p->idata);    p->idata = NULL;
+	stbi__free(p->out);      p->out = NULL;
+	stbi__free(p->expanded); p->expanded = NULL;
+	stbi__free(p->idata);    p->idata = NULL;
 
 	return result;
 }
@@ -5059,9 +6840,31 @@ static void* stbi__png_load(stbi__context* s, int* x, int* y, int* comp, int req
 {
 	stbi__png p;
 	p.s = s;
+	p.pal_out = NULL;
 	return stbi__do_png(&p, x, y, comp, req_comp, ri);
 }
 
+static stbi_uc* stbi__png_load_indexed(stbi__context* s, int* x, int* y, stbi_uc* palette, int* palette_len)
+{
+	stbi_uc* result = NULL;
+	stbi__png p;
+	p.s = s;
+	p.pal_out = palette;
+	p.pal_len = 0;
+	if (stbi__parse_png_file(&p, STBI__SCAN_load, 0)) {
+		result = p.out;
+		p.out = NULL;
+		*x = p.s->img_x;
+		*y = p.s->img_y;
+		if (palette_len)* palette_len = p.pal_len;
+	}
+	stbi__free(p.out);      p.out = NULL;
+	stbi__free(p.expanded); p.expanded = NULL;
+	stbi__free(p.idata);    p.idata = NULL;
+
+	return result;
+}
+
 static int stbi__png_test(stbi__context* s)
 {
 	int r;
@@ -5086,6 +6889,7 @@ static int stbi__png_info(stbi__context* s, int* x, int* y, int* comp)
 {
 	stbi__png p;
 	p.s = s;
+	p.pal_out = NULL;
 	return stbi__png_info_raw(&p, x, y, comp);
 }
 
@@ -5093,6 +6897,7 @@ static int stbi__png_is16(stbi__context* s)
 {
 	stbi__png p;
 	p.s = s;
+	p.pal_out = NULL;
 	if (!stbi__png_info_raw(&p, NULL, NULL, NULL))
 		return 0;
 	if (p.depth != 16) {
@@ -5272,11 +7077,11 @@ static void* stbi__bmp_parse_header(stbi__context* s, stbi__bmp_data* info)
 
 static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
 {
-	stbi_uc* out;
+	stbi_uc* out, * row;
 	unsigned int mr = 0, mg = 0, mb = 0, ma = 0, all_a;
 	stbi_uc pal[256][4];
 	int psize = 0, i, j, width;
-	int flip_vertically, pad, target;
+	int flip_vertically, pad, target, streaming;
 	stbi__bmp_data info;
 	STBI_NOTUSED(ri);
 
@@ -5284,7 +7089,9 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 	if (stbi__bmp_parse_header(s, &info) == NULL)
 		return NULL; // error code already set
 
-	flip_vertically = ((int)s->img_y) > 0;
+	// rows are stored bottom-up unless the height is negative; write them
+	// straight to where they end up, taking flip-on-load into account
+	flip_vertically = (((int)s->img_y) > 0) != s->flip_vertically;
 	s->img_y = abs((int)s->img_y);
 
 	mr = info.mr;
@@ -5315,11 +7122,17 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 	if (!stbi__mad3sizes_valid(target, s->img_x, s->img_y, 0))
 		return stbi__errpuc("too large", "Corrupt BMP");
 
-	out = (stbi_uc*)stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
+	// without alpha, rows are final as soon as they're read (alpha needs a
+	// pass over the whole image, see below)
+	streaming = s->stream && s->img_n == 3;
+	if (streaming)
+		out = stbi__stream_start(s, target, flip_vertically);
+	else
+		out = (stbi_uc*)stbi__malloc_mad3(target, s->img_x, s->img_y, 0);
 	if (!out) return stbi__errpuc("outofmem", "Out of memory");
 	if (info.bpp < 16) {
-		int z = 0;
-		if (psize == 0 || psize > 256) { STBI_FREE(out); return stbi__errpuc("invalid", "Corrupt BMP"); }
+		int z;
+		if (psize == 0 || psize > 256) { stbi__free_rows(s, out); return stbi__errpuc("invalid", "Corrupt BMP"); }
 		for (i = 0; i < psize; ++i) {
 			pal[i][2] = stbi__get8(s);
 			pal[i][1] = stbi__get8(s);
@@ -5331,17 +7144,19 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 		if (info.bpp == 1) width = (s->img_x + 7) >> 3;
 		else if (info.bpp == 4) width = (s->img_x + 1) >> 1;
 		else if (info.bpp == 8) width = s->img_x;
-		else { STBI_FREE(out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
+		else { stbi__free_rows(s, out); return stbi__errpuc("bad bpp", "Corrupt BMP"); }
 		pad = (-width) & 3;
 		if (info.bpp == 1) {
 			for (j = 0; j < (int)s->img_y; ++j) {
 				int bit_offset = 7, v = stbi__get8(s);
+				row = streaming ? stbi__stream_row(s) : out + (size_t)(flip_vertically ? s->img_y - 1 - j : (stbi__uint32)j) * s->img_x * target;
+				z = 0;
 				for (i = 0; i < (int)s->img_x; ++i) {
 					int color = (v >> bit_offset) & 0x1;
-					out[z++] = pal[color][0];
-					out[z++] = pal[color][1];
-					out[z++] = pal[color][2];
-					if (target == 4) out[z++] = 255;
+					row[z++] = pal[color][0];
+					row[z++] = pal[color][1];
+					row[z++] = pal[color][2];
+					if (target == 4) row[z++] = 255;
 					if (i + 1 == (int)s->img_x) break;
 					if ((--bit_offset) < 0) {
 						bit_offset = 7;
@@ -5349,34 +7164,38 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 					}
 				}
 				stbi__skip(s, pad);
+				if (streaming && !stbi__stream_put(s)) return NULL;
 			}
 		}
 		else {
 			for (j = 0; j < (int)s->img_y; ++j) {
+				row = streaming ? stbi__stream_row(s) : out + (size_t)(flip_vertically ? s->img_y - 1 - j : (stbi__uint32)j) * s->img_x * target;
+				z = 0;
 				for (i = 0; i < (int)s->img_x; i += 2) {
 					int v = stbi__get8(s), v2 = 0;
 					if (info.bpp == 4) {
 						v2 = v & 15;
 						v >>= 4;
 					}
-					out[z++] = pal[v][0];
-					out[z++] = pal[v][1];
-					out[z++] = pal[v][2];
-					if (target == 4) out[z++] = 255;
+					row[z++] = pal[v][0];
+					row[z++] = pal[v][1];
+					row[z++] = pal[v][2];
+					if (target == 4) row[z++] = 255;
 					if (i + 1 == (int)s->img_x) break;
 					v = (info.bpp == 8) ? stbi__get8(s) : v2;
-					out[z++] = pal[v][0];
-					out[z++] = pal[v][1];
-					out[z++] = pal[v][2];
-					if (target == 4) out[z++] = 255;
+					row[z++] = pal[v][0];
+					row[z++] = pal[v][1];
+					row[z++] = pal[v][2];
+					if (target == 4) row[z++] = 255;
 				}
 				stbi__skip(s, pad);
+				if (streaming && !stbi__stream_put(s)) return NULL;
 			}
 		}
 	}
 	else {
 		int rshift = 0, gshift = 0, bshift = 0, ashift = 0, rcount = 0, gcount = 0, bcount = 0, acount = 0;
-		int z = 0;
+		int z;
 		int easy = 0;
 		stbi__skip(s, info.offset - 14 - info.hsz);
 		if (info.bpp == 24) width = 3 * s->img_x;
@@ -5391,7 +7210,7 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 				easy = 2;
 		}
 		if (!easy) {
-			if (!mr || !mg || !mb) { STBI_FREE(out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
+			if (!mr || !mg || !mb) { stbi__free_rows(s, out); return stbi__errpuc("bad masks", "Corrupt BMP"); }
 			// right shift amt to put high bit in position #7
 			rshift = stbi__high_bit(mr) - 7; rcount = stbi__bitcount(mr);
 			gshift = stbi__high_bit(mg) - 7; gcount = stbi__bitcount(mg);
@@ -5399,16 +7218,18 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 			ashift = stbi__high_bit(ma) - 7; acount = stbi__bitcount(ma);
 		}
 		for (j = 0; j < (int)s->img_y; ++j) {
+			row = streaming ? stbi__stream_row(s) : out + (size_t)(flip_vertically ? s->img_y - 1 - j : (stbi__uint32)j) * s->img_x * target;
+			z = 0;
 			if (easy) {
 				for (i = 0; i < (int)s->img_x; ++i) {
 					unsigned char a;
-					out[z + 2] = stbi__get8(s);
-					out[z + 1] = stbi__get8(s);
-					out[z + 0] = stbi__get8(s);
+					row[z + 2] = stbi__get8(s);
+					row[z + 1] = stbi__get8(s);
+					row[z + 0] = stbi__get8(s);
 					z += 3;
 					a = (easy == 2 ? stbi__get8(s) : 255);
 					all_a |= a;
-					if (target == 4) out[z++] = a;
+					if (target == 4) row[z++] = a;
 				}
 			}
 			else {
@@ -5416,15 +7237,16 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 				for (i = 0; i < (int)s->img_x; ++i) {
 					stbi__uint32 v = (bpp == 16 ? (stbi__uint32)stbi__get16le(s) : stbi__get32le(s));
 					unsigned int a;
-					out[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mr, rshift, rcount));
-					out[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mg, gshift, gcount));
-					out[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mb, bshift, bcount));
+					row[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mr, rshift, rcount));
+					row[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mg, gshift, gcount));
+					row[z++] = STBI__BYTECAST(stbi__shiftsigned(v & mb, bshift, bcount));
 					a = (ma ? stbi__shiftsigned(v & ma, ashift, acount) : 255);
 					all_a |= a;
-					if (target == 4) out[z++] = STBI__BYTECAST(a);
+					if (target == 4) row[z++] = STBI__BYTECAST(a);
 				}
 			}
 			stbi__skip(s, pad);
+			if (streaming && !stbi__stream_put(s)) return NULL;
 		}
 	}
 
@@ -5433,18 +7255,7 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 		for (i = 4 * s->img_x * s->img_y - 1; i >= 0; i -= 4)
 			out[i] = 255;
 
-	if (flip_vertically) {
-		stbi_uc t;
-		for (j = 0; j < (int)s->img_y >> 1; ++j) {
-			stbi_uc* p1 = out + j * s->img_x * target;
-			stbi_uc* p2 = out + (s->img_y - 1 - j) * s->img_x * target;
-			for (i = 0; i < (int)s->img_x * target; ++i) {
-				t = p1[i]; p1[i] = p2[i]; p2[i] = t;
-			}
-		}
-	}
-
-	if (req_comp && req_comp != target) {
+	if (req_comp && req_comp != target && !streaming) {
 		out = stbi__convert_format(out, target, req_comp, s->img_x, s->img_y);
 		if (out == NULL) return out; // stbi__convert_format frees input on failure
 	}
@@ -5454,6 +7265,62 @@ static void* stbi__bmp_load(stbi__context* s, int* x, int* y, int* comp, int req
 	if (comp)* comp = s->img_n;
 	return out;
 }
+
+// the layouts stbi__bmp_load reads with its 'easy' loop can be used in place
+static int stbi__bmp_view(stbi__context* s, size_t len, stbi_view* view)
+{
+	stbi_uc const* buffer = s->img_buffer_original;
+	int w, h, bpp, comp, row_bytes;
+	stbi__bmp_data info;
+
+	info.all_a = 255;
+	if (stbi__bmp_parse_header(s, &info) == NULL)
+		return 0; // error code already set
+
+	w = (int)s->img_x;
+	h = abs((int)s->img_y);
+	if (info.bpp == 24) {
+		bpp = comp = 3;
+	}
+	else if (info.bpp == 32 && info.mr == 0x00ff0000 && info.mg == 0xff00 && info.mb == 0xff && (info.ma == 0 || info.ma == 0xff000000)) {
+		bpp = 4;
+		comp = info.ma ? 4 : 3;
+	}
+	else
+		return stbi__err("BMP not viewable", "Only uncompressed 24/32-bit BMP can be viewed");
+
+	if (w <= 0 || h <= 0 || !stbi__mad2sizes_valid(w, bpp, 3)) return stbi__err("bad size", "Corrupt BMP");
+	row_bytes = (w * bpp + 3) & ~3;
+	if (info.offset < 0 || (size_t)info.offset > len || len - info.offset < (size_t)w * bpp || (size_t)(h - 1) > (len - info.offset - w * bpp) / row_bytes)
+		return stbi__err("truncated", "Corrupt BMP");
+
+	if (info.all_a == 0) {
+		// as in stbi__bmp_load, an alpha channel that's all 0 was never filled in
+		int i, j, a = 0;
+		for (j = 0; j < h && !a; ++j) {
+			stbi_uc const* p = buffer + info.offset + j * row_bytes + 3;
+			for (i = 0; i < w; ++i)
+				a |= p[i * 4];
+		}
+		if (!a) comp = 3;
+	}
+
+	view->x = w;
+	view->y = h;
+	view->comp = comp;
+	view->bits_per_channel = 8;
+	view->bytes_per_pixel = bpp;
+	view->channel_order = STBI_ORDER_BGR;
+	if ((int)s->img_y > 0) { // bottom-up
+		view->pixels = buffer + info.offset + (ptrdiff_t)(h - 1) * row_bytes;
+		view->row_pitch = -row_bytes;
+	}
+	else {
+		view->pixels = buffer + info.offset;
+		view->row_pitch = row_bytes;
+	}
+	return 1;
+}
 #endif
 
 // Targa Truevision - TGA
@@ -5595,6 +7462,17 @@ static void stbi__tga_read_rgb16(stbi__context* s, stbi_uc* out)
 	// so let's treat all 15 and 16bit TGAs as RGB with no alpha.
 }
 
+// BGR(A) to RGB(A), in place
+static void stbi__tga_swap_rb(stbi_uc* p, int count, int comp)
+{
+	int i;
+	for (i = 0; i < count; ++i, p += comp) {
+		stbi_uc temp = p[0];
+		p[0] = p[2];
+		p[2] = temp;
+	}
+}
+
 static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
 {
 	//   read in the TGA header stuff
@@ -5610,7 +7488,7 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
 	int tga_width = stbi__get16le(s);
 	int tga_height = stbi__get16le(s);
 	int tga_bits_per_pixel = stbi__get8(s);
-	int tga_comp, tga_rgb16 = 0;
+	int tga_comp, tga_out, tga_rgb16 = 0;
 	int tga_inverted = stbi__get8(s);
 	// int tga_alpha_bits = tga_inverted & 15; // the 4 lowest bits - unused (useless?)
 	//   image data
@@ -5631,7 +7509,9 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
 		tga_image_type -= 8;
 		tga_is_RLE = 1;
 	}
-	tga_inverted = 1 - ((tga_inverted >> 5) & 1);
+	// rows are stored bottom-up unless bit 5 is set; write them straight to
+	// where they end up, taking flip-on-load into account
+	tga_inverted = (1 - ((tga_inverted >> 5) & 1)) != s->flip_vertically;
 
 	//   If I'm paletted, then I'll use the number of bits from the palette
 	if (tga_indexed) tga_comp = stbi__tga_get_comp(tga_palette_bits, 0, &tga_rgb16);
@@ -5645,23 +7525,42 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
 	*y = tga_height;
 	if (comp)* comp = tga_comp;
 
-	if (!stbi__mad3sizes_valid(tga_width, tga_height, tga_comp, 0))
+	// plain true-color rows are converted to req_comp as they're read
+	tga_out = (!tga_indexed && !tga_is_RLE && !tga_rgb16 && req_comp) ? req_comp : tga_comp;
+
+	if (!stbi__mad3sizes_valid(tga_width, tga_height, tga_out, 0))
 		return stbi__errpuc("too large", "Corrupt TGA");
 
-	tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, tga_comp, 0);
+	tga_data = (unsigned char*)stbi__malloc_mad3(tga_width, tga_height, tga_out, 0);
 	if (!tga_data) return stbi__errpuc("outofmem", "Out of memory");
 
 	// skip to the data's starting position (offset usually = 0)
 	stbi__skip(s, tga_offset);
 
 	if (!tga_indexed && !tga_is_RLE && !tga_rgb16) {
+		stbi_uc* tga_scratch = NULL;
+		if (tga_out != tga_comp) {
+			tga_scratch = (stbi_uc*)stbi__malloc_mad2(tga_width, tga_comp, 0);
+			if (!tga_scratch) {
+				stbi__free(tga_data);
+				return stbi__errpuc("outofmem", "Out of memory");
+			}
+		}
 		for (i = 0; i < tga_height; ++i) {
 			int row = tga_inverted ? tga_height - i - 1 : i;
-			stbi_uc* tga_row = tga_data + row * tga_width * tga_comp;
-			stbi__getn(s, tga_row, tga_width * tga_comp);
+			stbi_uc* tga_row = tga_data + row * tga_width * tga_out;
+			stbi_uc* raw = tga_scratch ? tga_scratch : tga_row;
+			stbi__getn(s, raw, tga_width * tga_comp);
+			if (tga_comp >= 3)
+				stbi__tga_swap_rb(raw, tga_width, tga_comp);
+			if (tga_scratch)
+				stbi__convert_row(tga_row, raw, tga_comp, tga_out, tga_width);
 		}
+		stbi__free(tga_scratch);
 	}
 	else {
+		stbi_uc* tga_row = tga_data;
+		int tga_col = tga_width;
 		//   do I need to load a palette?
 		if (tga_indexed)
 		{
@@ -5670,7 +7569,7 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
 			//   load the palette
 			tga_palette = (unsigned char*)stbi__malloc_mad2(tga_palette_len, tga_comp, 0);
 			if (!tga_palette) {
-				STBI_FREE(tga_data);
+				stbi__free(tga_data);
 				return stbi__errpuc("outofmem", "Out of memory");
 			}
 			if (tga_rgb16) {
@@ -5682,8 +7581,8 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
 				}
 			}
 			else if (!stbi__getn(s, tga_palette, tga_palette_len * tga_comp)) {
-				STBI_FREE(tga_data);
-				STBI_FREE(tga_palette);
+				stbi__free(tga_data);
+				stbi__free(tga_palette);
 				return stbi__errpuc("bad palette", "Corrupt TGA");
 			}
 		}
@@ -5741,52 +7640,33 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
 				read_next_pixel = 0;
 			} // end of reading a pixel
 
-			// copy data
+			// copy data, starting a new output row when needed
+			if (tga_col == tga_width) {
+				int row = i / tga_width;
+				tga_row = tga_data + (tga_inverted ? tga_height - row - 1 : row) * tga_width * tga_comp;
+				tga_col = 0;
+			}
 			for (j = 0; j < tga_comp; ++j)
-				tga_data[i * tga_comp + j] = raw_data[j];
+				tga_row[j] = raw_data[j];
+			tga_row += tga_comp;
+			++tga_col;
 
 			//   in case we're in RLE mode, keep counting down
 			--RLE_count;
 		}
-		//   do I need to invert the image?
-		if (tga_inverted)
-		{
-			for (j = 0; j * 2 < tga_height; ++j)
-			{
-				int index1 = j * tga_width * tga_comp;
-				int index2 = (tga_height - 1 - j) * tga_width * tga_comp;
-				for (i = tga_width * tga_comp; i > 0; --i)
-				{
-					unsigned char temp = tga_data[index1];
-					tga_data[index1] = tga_data[index2];
-					tga_data[index2] = temp;
-					++index1;
-					++index2;
-				}
-			}
-		}
 		//   clear my palette, if I had one
 		if (tga_palette != NULL)
 		{
-			STBI_FREE(tga_palette);
+			stbi__free(tga_palette);
 		}
-	}
 
-	// swap RGB - if the source data was RGB16, it already is in the right order
-	if (tga_comp >= 3 && !tga_rgb16)
-	{
-		unsigned char* tga_pixel = tga_data;
-		for (i = 0; i < tga_width * tga_height; ++i)
-		{
-			unsigned char temp = tga_pixel[0];
-			tga_pixel[0] = tga_pixel[2];
-			tga_pixel[2] = temp;
-			tga_pixel += tga_comp;
-		}
+		// swap RGB - if the source data was RGB16, it already is in the right order
+		if (tga_comp >= 3 && !tga_rgb16)
+			stbi__tga_swap_rb(tga_data, tga_width * tga_height, tga_comp);
 	}
 
 	// convert to target component count
-	if (req_comp && req_comp != tga_comp)
+	if (req_comp && req_comp != tga_out)
 		tga_data = stbi__convert_format(tga_data, tga_comp, req_comp, tga_width, tga_height);
 
 	//   the things I do to get rid of an error message, and yet keep
@@ -5797,11 +7677,193 @@ static void* stbi__tga_load(stbi__context* s, int* x, int* y, int* comp, int req
 	//   OK, done
 	return tga_data;
 }
+
+// uncompressed true-color TGA is stored as BGR(A) rows and can be used in place
+static int stbi__tga_view(stbi__context* s, size_t len, stbi_view* view)
+{
+	stbi_uc const* buffer = s->img_buffer_original;
+	int tga_offset = stbi__get8(s);
+	int tga_indexed = stbi__get8(s);
+	int tga_image_type = stbi__get8(s);
+	int tga_width, tga_height, tga_bits_per_pixel, tga_inverted, row_bytes;
+	stbi__skip(s, 9); // skip colormap specification and image x/y origin
+	tga_width = stbi__get16le(s);
+	tga_height = stbi__get16le(s);
+	tga_bits_per_pixel = stbi__get8(s);
+	tga_inverted = stbi__get8(s);
+
+	if (tga_indexed || tga_image_type != 2 || (tga_bits_per_pixel != 24 && tga_bits_per_pixel != 32))
+		return stbi__err("TGA not viewable", "Only uncompressed 24/32-bit TGA can be viewed");
+
+	tga_offset += 18;
+	row_bytes = tga_width * (tga_bits_per_pixel / 8);
+	if (len < (size_t)tga_offset || (len - tga_offset) / row_bytes < (size_t)tga_height)
+		return stbi__err("truncated", "Corrupt TGA");
+
+	view->x = tga_width;
+	view->y = tga_height;
+	view->comp = view->bytes_per_pixel = tga_bits_per_pixel / 8;
+	view->bits_per_channel = 8;
+	view->channel_order = STBI_ORDER_BGR;
+	if (tga_inverted & 32) {
+		view->pixels = buffer + tga_offset;
+		view->row_pitch = row_bytes;
+	}
+	else {
+		view->pixels = buffer + tga_offset + (ptrdiff_t)(tga_height - 1) * row_bytes;
+		view->row_pitch = -row_bytes;
+	}
+	return 1;
+}
+#endif
+
+STBIDEF int stbi_view_from_memory(stbi_uc const* buffer, size_t len, stbi_view* view)
+{
+	int ok;
+	stbi__context s;
+	// only the header is parsed through the context, so it doesn't need the full length
+	stbi__start_mem(&s, buffer, len > INT_MAX ? INT_MAX : (int)len);
+
+#ifndef STBI_NO_BMP
+	if (stbi__bmp_test(&s)) ok = stbi__bmp_view(&s, len, view);
+	else
+#endif
+#ifndef STBI_NO_PNM
+	if (stbi__pnm_test(&s)) ok = stbi__pnm_view(&s, len, view);
+	else
+#endif
+#ifndef STBI_NO_TGA
+	if (stbi__tga_test(&s)) ok = stbi__tga_view(&s, len, view);
+	else
 #endif
+		ok = stbi__err("not viewable", "Only uncompressed BMP/TGA and binary PNM can be viewed");
+
+	if (ok && stbi__vertically_flip_on_load) {
+		// flipping a view is free: start from the other end and walk backwards
+		view->pixels += (ptrdiff_t)(view->y - 1) * view->row_pitch;
+		view->row_pitch = -view->row_pitch;
+	}
+	return ok;
+}
+
+// both conversions swizzle into 3 or 4 channels directly; grey is a
+// post-conversion like everywhere else. a view with the other bit depth goes
+// through the matching conversion first, exactly like the regular loaders
+STBIDEF stbi_uc* stbi_view_convert(stbi_view const* view, int req_comp)
+{
+	int i, j, n, bpp = view->bytes_per_pixel;
+	int r = (view->channel_order == STBI_ORDER_BGR) ? 2 : 0, b = 2 - r;
+	stbi_uc* out, * p;
+
+	if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+	if (view->bits_per_channel == 16) {
+		stbi__uint16* wide = (stbi__uint16*)stbi_view_convert_16(view, req_comp);
+		if (wide == NULL) return NULL;
+		return stbi__convert_16_to_8(wide, view->x, view->y, req_comp ? req_comp : view->comp);
+	}
+
+	n = (req_comp >= 3 && view->comp >= 3) ? req_comp : view->comp;
+	if (!stbi__mad3sizes_valid(n, view->x, view->y, 0)) return stbi__errpuc("too large", "Image too large to decode");
+	out = (stbi_uc*)stbi__malloc_mad3(n, view->x, view->y, 0);
+	if (!out) return stbi__errpuc("outofmem", "Out of memory");
+
+	p = out;
+	for (j = 0; j < view->y; ++j) {
+		stbi_uc const* src = view->pixels + (ptrdiff_t)j * view->row_pitch;
+		if (view->comp < 3) {
+			memcpy(p, src, (size_t)view->x * n);
+			p += view->x * n;
+			continue;
+		}
+		for (i = 0; i < view->x; ++i, src += bpp, p += n) {
+			p[0] = src[r];
+			p[1] = src[1];
+			p[2] = src[b];
+			if (n == 4) p[3] = (view->comp == 4) ? src[3] : 255;
+		}
+	}
+
+	if (req_comp && req_comp != n)
+		out = stbi__convert_format(out, n, req_comp, view->x, view->y); // frees input on failure
+	return out;
+}
+
+STBIDEF stbi_us* stbi_view_convert_16(stbi_view const* view, int req_comp)
+{
+	int i, j, k, n, bpp = view->bytes_per_pixel;
+	int bgr = (view->channel_order == STBI_ORDER_BGR);
+	stbi__uint16* out, * p;
+
+	if (req_comp < 0 || req_comp > 4) return (stbi_us*)stbi__errpuc("bad req_comp", "Internal error");
+	if (view->bits_per_channel == 8) {
+		stbi_uc* narrow = stbi_view_convert(view, req_comp);
+		if (narrow == NULL) return NULL;
+		return stbi__convert_8_to_16(narrow, view->x, view->y, req_comp ? req_comp : view->comp);
+	}
+
+	n = (req_comp >= 3 && view->comp >= 3) ? req_comp : view->comp;
+	if (!stbi__mad4sizes_valid(n, view->x, view->y, 2, 0)) return (stbi_us*)stbi__errpuc("too large", "Image too large to decode");
+	out = (stbi__uint16*)stbi__malloc_mad4(n, view->x, view->y, 2, 0);
+	if (!out) return (stbi_us*)stbi__errpuc("outofmem", "Out of memory");
+
+	p = out;
+	for (j = 0; j < view->y; ++j) {
+		stbi_uc const* src = view->pixels + (ptrdiff_t)j * view->row_pitch;
+		if (n == view->comp && !bgr) {
+			// samples are already in place, they just need to be in native byte order
+			stbi__swap16_from_be(p, src, (size_t)view->x * n);
+			p += view->x * n;
+			continue;
+		}
+		for (i = 0; i < view->x; ++i, src += bpp, p += n) {
+			for (k = 0; k < n; ++k) {
+				int c = (bgr && k != 1 && k < 3) ? 2 - k : k;
+				p[k] = (c < view->comp) ? (stbi__uint16)((src[c * 2] << 8) | src[c * 2 + 1]) : 0xffff;
+			}
+		}
+	}
+
+	if (req_comp && req_comp != n)
+		out = stbi__convert_format16(out, n, req_comp, view->x, view->y); // frees input on failure
+	return (stbi_us*)out;
+}
 
 // *************************************************************************************************
 // Photoshop PSD loader -- PD by Thatcher Ulrich, integration by Nicolas Schulz, tweaked by STB
 
+#if !defined(STBI_NO_PSD) || !defined(STBI_NO_HDR)
+// PSD and HDR store RLE data one component plane at a time; put 'width' bytes
+// of 4 planes, 'plane_stride' apart, back together
+static void stbi__interleave4(stbi_uc* out, stbi_uc* planes, int plane_stride, int width, int simd)
+{
+	stbi_uc* r = planes, * g = planes + plane_stride, * b = planes + 2 * plane_stride, * e = planes + 3 * plane_stride;
+	int i = 0;
+	STBI_NOTUSED(simd);
+#ifdef STBI_SSE2
+	if (simd) {
+		for (; i + 16 <= width; i += 16) {
+			__m128i vr = _mm_loadu_si128((__m128i*) (r + i));
+			__m128i vg = _mm_loadu_si128((__m128i*) (g + i));
+			__m128i vb = _mm_loadu_si128((__m128i*) (b + i));
+			__m128i ve = _mm_loadu_si128((__m128i*) (e + i));
+			__m128i rg_lo = _mm_unpacklo_epi8(vr, vg), rg_hi = _mm_unpackhi_epi8(vr, vg);
+			__m128i be_lo = _mm_unpacklo_epi8(vb, ve), be_hi = _mm_unpackhi_epi8(vb, ve);
+			_mm_storeu_si128((__m128i*) (out + i * 4), _mm_unpacklo_epi16(rg_lo, be_lo));
+			_mm_storeu_si128((__m128i*) (out + i * 4 + 16), _mm_unpackhi_epi16(rg_lo, be_lo));
+			_mm_storeu_si128((__m128i*) (out + i * 4 + 32), _mm_unpacklo_epi16(rg_hi, be_hi));
+			_mm_storeu_si128((__m128i*) (out + i * 4 + 48), _mm_unpackhi_epi16(rg_hi, be_hi));
+		}
+	}
+#endif
+	for (; i < width; ++i) {
+		out[i * 4 + 0] = r[i];
+		out[i * 4 + 1] = g[i];
+		out[i * 4 + 2] = b[i];
+		out[i * 4 + 3] = e[i];
+	}
+}
+#endif
+
 #ifndef STBI_NO_PSD
 static int stbi__psd_test(stbi__context* s)
 {
@@ -5810,9 +7872,11 @@ static int stbi__psd_test(stbi__context* s)
 	return r;
 }
 
-static int stbi__psd_decode_rle(stbi__context* s, stbi_uc* p, int pixelCount)
+// writes every 4th byte from 'p'; after each row of 'width' pixels, 'p' also
+// moves by 'row_skip' (to go back up the image when flipping on load)
+static int stbi__psd_decode_rle(stbi__context* s, stbi_uc* p, int pixelCount, int width, int row_skip)
 {
-	int count, nleft, len;
+	int count, nleft, len, col = 0;
 
 	count = 0;
 	while ((nleft = pixelCount - count) > 0) {
@@ -5828,6 +7892,7 @@ static int stbi__psd_decode_rle(stbi__context* s, stbi_uc* p, int pixelCount)
 			while (len) {
 				*p = stbi__get8(s);
 				p += 4;
+				if (++col == width) { col = 0; p += row_skip; }
 				len--;
 			}
 		}
@@ -5842,6 +7907,7 @@ static int stbi__psd_decode_rle(stbi__context* s, stbi_uc* p, int pixelCount)
 			while (len) {
 				*p = val;
 				p += 4;
+				if (++col == width) { col = 0; p += row_skip; }
 				len--;
 			}
 		}
@@ -5850,11 +7916,147 @@ static int stbi__psd_decode_rle(stbi__context* s, stbi_uc* p, int pixelCount)
 	return 1;
 }
 
+// decode one row of RLE data into consecutive bytes; 'end' comes from the
+// row's byte count, so a row can never run into the next one
+static int stbi__psd_decode_rle_row(stbi_uc const* p, stbi_uc const* end, stbi_uc* out, int width)
+{
+	int count = 0, len;
+	while (count < width) {
+		if (p >= end) return 0; // corrupt data
+		len = *p++;
+		if (len < 128) {
+			len++;
+			if (len > width - count || len > end - p) return 0; // corrupt data
+			memcpy(out + count, p, len);
+			p += len;
+			count += len;
+		}
+		else if (len > 128) {
+			len = 257 - len;
+			if (len > width - count || p >= end) return 0; // corrupt data
+			memset(out + count, *p++, len);
+			count += len;
+		}
+	}
+	return 1;
+}
+
+#define STBI__PSD_MIN_BAND_ROWS  16
+#define STBI__PSD_MAX_BANDS      64
+
+typedef struct
+{
+	stbi_uc* out;
+	stbi_uc* scratch;            // 4 planes of band_rows*w bytes per band (just one set if serial)
+	stbi_uc const** row_start;   // row j of channel c is [c*h+j], plus the end of the last row
+	int w, h, channels, band_rows, serial, flip, simd;
+	int ok[STBI__PSD_MAX_BANDS];
+} stbi__psd_bands;
+
+static void stbi__psd_decode_band(void* data, int band)
+{
+	stbi__psd_bands* b = (stbi__psd_bands*)data;
+	int j0 = band * b->band_rows, rows = b->h - j0, n, c, j;
+	stbi_uc* planes;
+	if (rows > b->band_rows) rows = b->band_rows;
+	n = rows * b->w;
+	planes = b->scratch + (b->serial ? 0 : (size_t)band * b->band_rows * b->w * 4);
+	b->ok[band] = 0;
+	for (c = 0; c < 4; ++c) {
+		stbi_uc* plane = planes + (size_t)c * n;
+		if (c >= b->channels) {
+			// Fill this channel with default data.
+			memset(plane, c == 3 ? 255 : 0, n);
+			continue;
+		}
+		for (j = 0; j < rows; ++j) {
+			int k = c * b->h + j0 + j;
+			if (!stbi__psd_decode_rle_row(b->row_start[k], b->row_start[k + 1], plane + (size_t)j * b->w, b->w))
+				return;
+		}
+	}
+	if (b->flip) {
+		for (j = 0; j < rows; ++j)
+			stbi__interleave4(b->out + (size_t)(b->h - 1 - j0 - j) * b->w * 4, planes + (size_t)j * b->w, n, b->w, b->simd);
+	}
+	else
+		stbi__interleave4(b->out + (size_t)j0 * b->w * 4, planes, n, n, b->simd);
+	b->ok[band] = 1;
+}
+
+// the per-row byte counts in front of the RLE data say where every row of every
+// channel starts, so when the data is in memory we can decode bands of rows
+// independently, through the user's parallel-for if there is one. returns 0
+// (without consuming anything) if the caller should decode the stream serially
+static int stbi__psd_decode_rle_bands(stbi__context* s, stbi_uc* out, int w, int h, int channelCount)
+{
+	stbi__psd_bands b;
+	stbi_uc const* counts = s->img_buffer;
+	size_t avail = (size_t)(s->img_buffer_end - s->img_buffer), off;
+	int used = channelCount < 4 ? channelCount : 4;
+	int i, nbands, ok = 1;
+
+	if (s->io.read != NULL || w <= 0 || h <= 0 || avail < (size_t)h * channelCount * 2)
+		return 0;
+
+	b.row_start = (stbi_uc const**)stbi__malloc(sizeof(stbi_uc*) * ((size_t)used * h + 1));
+	if (!b.row_start) return 0;
+	off = (size_t)h * channelCount * 2;
+	for (i = 0; i < used * h; ++i) {
+		b.row_start[i] = counts + off;
+		off += (counts[i * 2] << 8) | counts[i * 2 + 1];
+		if (off > avail) {
+			stbi__free(b.row_start);
+			return 0;
+		}
+	}
+	b.row_start[used * h] = counts + off;
+
+	b.band_rows = STBI__PSD_MIN_BAND_ROWS;
+	if (h / b.band_rows >= STBI__PSD_MAX_BANDS)
+		b.band_rows = (h + STBI__PSD_MAX_BANDS - 1) / STBI__PSD_MAX_BANDS;
+	if (b.band_rows > h) b.band_rows = h;
+	nbands = (h + b.band_rows - 1) / b.band_rows;
+	b.serial = (stbi__parallel_for == NULL || nbands == 1);
+	if (!stbi__mad3sizes_valid(b.serial ? 1 : nbands, b.band_rows * w, 4, 0)) {
+		stbi__free(b.row_start);
+		return 0;
+	}
+	b.scratch = (stbi_uc*)stbi__malloc_mad3(b.serial ? 1 : nbands, b.band_rows * w, 4, 0);
+	if (!b.scratch) {
+		stbi__free(b.row_start);
+		return 0;
+	}
+	b.out = out;
+	b.w = w;
+	b.h = h;
+	b.channels = channelCount;
+	b.flip = s->flip_vertically;
+	b.simd = 0;
+#ifdef STBI_SSE2
+	b.simd = stbi__sse2_available();
+#endif
+
+	if (b.serial)
+		for (i = 0; i < nbands; ++i)
+			stbi__psd_decode_band(&b, i);
+	else
+		stbi__parallel_for(stbi__parallel_for_user, stbi__psd_decode_band, &b, nbands);
+	for (i = 0; i < nbands; ++i)
+		ok &= b.ok[i];
+	if (ok)
+		s->img_buffer = (stbi_uc*)b.row_start[used * h];
+
+	stbi__free(b.scratch);
+	stbi__free(b.row_start);
+	return ok;
+}
+
 static void* stbi__psd_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri, int bpc)
 {
-	int pixelCount;
+	int pixelCount, first_row, row_skip;
 	int channelCount, compression;
-	int channel, i;
+	int channel, i, j;
 	int bitdepth;
 	int w, h;
 	stbi_uc* out;
@@ -5931,6 +8133,11 @@ static void* stbi__psd_load(stbi__context* s, int* x, int* y, int* comp, int req
 	if (!out) return stbi__errpuc("outofmem", "Out of memory");
 	pixelCount = w * h;
 
+	// channels are stored one after another, each top to bottom. when flipping,
+	// start each one on the last row and step back up after each row
+	first_row = (s->flip_vertically && h > 0) ? (h - 1) * w * 4 : 0;
+	row_skip = s->flip_vertically ? -8 * w : 0;
+
 	// Initialize the data to zero.
 	//memset( out, 0, pixelCount * 4 );
 
@@ -5944,25 +8151,27 @@ static void* stbi__psd_load(stbi__context* s, int* x, int* y, int* comp, int req
 		//     Else if n is 128, noop.
 		// Endloop
 
-		// The RLE-compressed data is preceded by a 2-byte data count for each row in the data,
-		// which we're going to just skip.
-		stbi__skip(s, h * channelCount * 2);
+		// The RLE-compressed data is preceded by a 2-byte data count for each row in the data.
+		// If it's all in memory, use them to decode rows independently; otherwise just skip them.
+		if (bitdepth != 8 || !stbi__psd_decode_rle_bands(s, out, w, h, channelCount)) {
+			stbi__skip(s, h * channelCount * 2);
 
-		// Read the RLE data by channel.
-		for (channel = 0; channel < 4; channel++) {
-			stbi_uc* p;
+			// Read the RLE data by channel.
+			for (channel = 0; channel < 4; channel++) {
+				stbi_uc* p;
 
-			p = out + channel;
-			if (channel >= channelCount) {
-				// Fill this channel with default data.
-				for (i = 0; i < pixelCount; i++, p += 4)
-					* p = (channel == 3 ? 255 : 0);
-			}
-			else {
-				// Read the RLE data.
-				if (!stbi__psd_decode_rle(s, p, pixelCount)) {
-					STBI_FREE(out);
-					return stbi__errpuc("corrupt", "bad RLE data");
+				p = out + channel;
+				if (channel >= channelCount) {
+					// Fill this channel with default data.
+					for (i = 0; i < pixelCount; i++, p += 4)
+						* p = (channel == 3 ? 255 : 0);
+				}
+				else {
+					// Read the RLE data.
+					if (!stbi__psd_decode_rle(s, p + first_row, pixelCount, w, row_skip)) {
+						stbi__free(out);
+						return stbi__errpuc("corrupt", "bad RLE data");
+					}
 				}
 			}
 		}
@@ -5991,19 +8200,22 @@ static void* stbi__psd_load(stbi__context* s, int* x, int* y, int* comp, int req
 			}
 			else {
 				if (ri->bits_per_channel == 16) {    // output bpc
-					stbi__uint16* q = ((stbi__uint16*)out) + channel;
-					for (i = 0; i < pixelCount; i++, q += 4)
-						* q = (stbi__uint16)stbi__get16be(s);
+					stbi__uint16* q = ((stbi__uint16*)out) + channel + first_row;
+					for (j = 0; j < h; j++, q += row_skip)
+						for (i = 0; i < w; i++, q += 4)
+							* q = (stbi__uint16)stbi__get16be(s);
 				}
 				else {
-					stbi_uc* p = out + channel;
+					stbi_uc* p = out + channel + first_row;
 					if (bitdepth == 16) {  // input bpc
-						for (i = 0; i < pixelCount; i++, p += 4)
-							* p = (stbi_uc)(stbi__get16be(s) >> 8);
+						for (j = 0; j < h; j++, p += row_skip)
+							for (i = 0; i < w; i++, p += 4)
+								* p = (stbi_uc)(stbi__get16be(s) >> 8);
 					}
 					else {
-						for (i = 0; i < pixelCount; i++, p += 4)
-							* p = stbi__get8(s);
+						for (j = 0; j < h; j++, p += row_skip)
+							for (i = 0; i < w; i++, p += 4)
+								* p = stbi__get8(s);
 					}
 				}
 			}
@@ -6152,7 +8364,7 @@ static stbi_uc* stbi__pic_load_core(stbi__context* s, int width, int height, int
 
 		for (packet_idx = 0; packet_idx < num_packets; ++packet_idx) {
 			stbi__pic_packet* packet = &packets[packet_idx];
-			stbi_uc* dest = result + y * width * 4;
+			stbi_uc* dest = result + stbi__out_row(s, y, height) * width * 4;
 
 			switch (packet->type) {
 			default:
@@ -6252,10 +8464,11 @@ static void* stbi__pic_load(stbi__context* s, int* px, int* py, int* comp, int r
 
 	// intermediate buffer is RGBA
 	result = (stbi_uc*)stbi__malloc_mad3(x, y, 4, 0);
+	if (!result) return stbi__errpuc("outofmem", "Out of memory");
 	memset(result, 0xff, x * y * 4);
 
 	if (!stbi__pic_load_core(s, x, y, comp, result)) {
-		STBI_FREE(result);
+		stbi__free(result);
 		result = 0;
 	}
 	*px = x;
@@ -6291,6 +8504,8 @@ typedef struct
 	stbi_uc* out;                 // output buffer (always 4 components)
 	stbi_uc* background;          // The current "background" as far as a gif is concerned
 	stbi_uc* history;
+	stbi_uc* indices;             // palette index per pixel, only if 'indexed' is set
+	int indexed;
 	int flags, bgindex, ratio, transparent, eflags;
 	stbi_uc  pal[256][4];
 	stbi_uc lpal[256][4];
@@ -6302,6 +8517,7 @@ typedef struct
 	int max_x, max_y;
 	int cur_x, cur_y;
 	int line_size;
+	int flip; // rows are placed bottom-to-top
 	int delay;
 } stbi__gif;
 
@@ -6343,7 +8559,7 @@ static int stbi__gif_header(stbi__context* s, stbi__gif* g, int* comp, int is_in
 	if (version != '7' && version != '9')    return stbi__err("not GIF", "Corrupt GIF");
 	if (stbi__get8(s) != 'a')                return stbi__err("not GIF", "Corrupt GIF");
 
-	stbi__g_failure_reason = "";
+	stbi__set_failure_reason("");
 	g->w = stbi__get16le(s);
 	g->h = stbi__get16le(s);
 	g->flags = stbi__get8(s);
@@ -6364,14 +8580,15 @@ static int stbi__gif_header(stbi__context* s, stbi__gif* g, int* comp, int is_in
 static int stbi__gif_info_raw(stbi__context* s, int* x, int* y, int* comp)
 {
 	stbi__gif* g = (stbi__gif*)stbi__malloc(sizeof(stbi__gif));
+	if (!g) return stbi__err("outofmem", "Out of memory");
 	if (!stbi__gif_header(s, g, comp, 1)) {
-		STBI_FREE(g);
+		stbi__free(g);
 		stbi__rewind(s);
 		return 0;
 	}
 	if (x)* x = g->w;
 	if (y)* y = g->h;
-	STBI_FREE(g);
+	stbi__free(g);
 	return 1;
 }
 
@@ -6387,9 +8604,13 @@ static void stbi__out_gif_code(stbi__gif* g, stbi__uint16 code)
 
 	if (g->cur_y >= g->max_y) return;
 
-	idx = g->cur_x + g->cur_y;
+	// cur_y walks the frame top-down; only where it lands is flipped, so the
+	// disposal buffers all share the flipped layout and compose unchanged
+	idx = g->cur_x + (g->flip ? (g->h - 1) * g->line_size - g->cur_y : g->cur_y);
 	p = &g->out[idx];
 	g->history[idx / 4] = 1;
+	if (g->indices)
+		g->indices[idx / 4] = g->codes[code].suffix;
 
 	c = &g->color_table[g->codes[code].suffix * 4];
 	if (c[3] > 128) { // don't render transparent pixels; 
@@ -6512,6 +8733,8 @@ static stbi_uc* stbi__gif_load_next(stbi__context* s, stbi__gif* g, int* comp, i
 	int pcount;
 	STBI_NOTUSED(req_comp);
 
+	g->flip = s->flip_vertically;
+
 	// on first frame, any non-written pixels get the background colour (non-transparent)
 	first_frame = 0;
 	if (g->out == 0) {
@@ -6531,6 +8754,12 @@ static stbi_uc* stbi__gif_load_next(stbi__context* s, stbi__gif* g, int* comp, i
 		memset(g->out, 0x00, 4 * pcount);
 		memset(g->background, 0x00, 4 * pcount); // state of the background (starts transparent)
 		memset(g->history, 0x00, pcount);        // pixels that were affected previous frame
+		if (g->indexed) {
+			g->indices = (stbi_uc*)stbi__malloc(pcount);
+			if (!g->indices)
+				return stbi__errpuc("outofmem", "Out of memory");
+			memset(g->indices, g->bgindex, pcount);
+		}
 		first_frame = 1;
 	}
 	else {
@@ -6686,6 +8915,19 @@ static stbi_uc* stbi__gif_load_next(stbi__context* s, stbi__gif* g, int* comp, i
 	}
 }
 
+static void* stbi__load_gif_main_outofmem(stbi__gif* g, stbi_uc* out, int** delays)
+{
+	stbi__free(g->out);
+	stbi__free(g->history);
+	stbi__free(g->background);
+	stbi__free(out);
+	if (delays && *delays) {
+		stbi__free(*delays);
+		*delays = 0;
+	}
+	return stbi__errpuc("outofmem", "Out of memory");
+}
+
 static void* stbi__load_gif_main(stbi__context* s, int** delays, int* x, int* y, int* z, int* comp, int req_comp)
 {
 	if (stbi__gif_test(s)) {
@@ -6711,15 +8953,21 @@ static void* stbi__load_gif_main(stbi__context* s, int** delays, int* x, int* y,
 				stride = g.w * g.h * 4;
 
 				if (out) {
-					out = (stbi_uc*)STBI_REALLOC(out, layers * stride);
+					void* tmp = stbi__realloc_sized(out, (layers - 1) * stride, layers * stride);
+					if (!tmp) return stbi__load_gif_main_outofmem(&g, out, delays);
+					out = (stbi_uc*)tmp;
 					if (delays) {
-						*delays = (int*)STBI_REALLOC(*delays, sizeof(int) * layers);
+						tmp = stbi__realloc_sized(*delays, sizeof(int) * (layers - 1), sizeof(int) * layers);
+						if (!tmp) return stbi__load_gif_main_outofmem(&g, out, delays);
+						*delays = (int*)tmp;
 					}
 				}
 				else {
 					out = (stbi_uc*)stbi__malloc(layers * stride);
+					if (!out) return stbi__load_gif_main_outofmem(&g, out, delays);
 					if (delays) {
 						*delays = (int*)stbi__malloc(layers * sizeof(int));
+						if (!*delays) return stbi__load_gif_main_outofmem(&g, out, delays);
 					}
 				}
 				memcpy(out + ((layers - 1) * stride), u, stride);
@@ -6734,9 +8982,9 @@ static void* stbi__load_gif_main(stbi__context* s, int** delays, int* x, int* y,
 		} while (u != 0);
 
 		// free temp buffer; 
-		STBI_FREE(g.out);
-		STBI_FREE(g.history);
-		STBI_FREE(g.background);
+		stbi__free(g.out);
+		stbi__free(g.history);
+		stbi__free(g.background);
 
 		// do the final conversion after loading everything; 
 		if (req_comp && req_comp != 4)
@@ -6770,12 +9018,46 @@ static void* stbi__gif_load(stbi__context* s, int* x, int* y, int* comp, int req
 	}
 	else if (g.out) {
 		// if there was an error and we allocated an image buffer, free it!
-		STBI_FREE(g.out);
+		stbi__free(g.out);
 	}
 
 	// free buffers needed for multiple frame loading; 
-	STBI_FREE(g.history);
-	STBI_FREE(g.background);
+	stbi__free(g.history);
+	stbi__free(g.background);
+
+	return u;
+}
+
+static stbi_uc* stbi__gif_load_indexed(stbi__context* s, int* x, int* y, stbi_uc* palette, int* palette_len)
+{
+	stbi_uc* u = 0;
+	stbi__gif g;
+	memset(&g, 0, sizeof(g));
+	g.indexed = 1;
+
+	u = stbi__gif_load_next(s, &g, NULL, 0, 0);
+	if (u == (stbi_uc*)s) u = 0;  // end of animated gif marker
+	if (u) {
+		int i, n = (g.color_table == (stbi_uc*)g.lpal) ? 2 << (g.lflags & 7) : 2 << (g.flags & 7);
+		// color tables are stored BGRA
+		for (i = 0; i < n; ++i) {
+			palette[i * 4 + 0] = g.color_table[i * 4 + 2];
+			palette[i * 4 + 1] = g.color_table[i * 4 + 1];
+			palette[i * 4 + 2] = g.color_table[i * 4 + 0];
+			palette[i * 4 + 3] = g.color_table[i * 4 + 3];
+		}
+		if (palette_len)* palette_len = n;
+		*x = g.w;
+		*y = g.h;
+		u = g.indices;
+	}
+	else {
+		stbi__free(g.indices);
+	}
+
+	stbi__free(g.out);
+	stbi__free(g.history);
+	stbi__free(g.background);
 
 	return u;
 }
@@ -6862,137 +9144,527 @@ static void stbi__hdr_convert(float* output, stbi_uc* input, int req_comp)
 	}
 }
 
-static float* stbi__hdr_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
+typedef union
 {
-	char buffer[STBI__HDR_BUFLEN];
-	char* token;
-	int valid = 0;
-	int width, height;
-	stbi_uc* scanline;
-	float* hdr_data;
-	int len;
-	unsigned char count, value;
-	int i, j, k, c1, c2, z;
-	const char* headerToken;
-	STBI_NOTUSED(ri);
+	stbi__uint32 u;
+	float f;
+} stbi__fp32;
 
-	// Check identifier
-	headerToken = stbi__hdr_gettoken(s, buffer);
-	if (strcmp(headerToken, "#?RADIANCE") != 0 && strcmp(headerToken, "#?RGBE") != 0)
-		return stbi__errpf("not HDR", "Corrupt HDR image");
-
-	// Parse header
-	for (;;) {
-		token = stbi__hdr_gettoken(s, buffer);
-		if (token[0] == 0) break;
-		if (strcmp(token, "FORMAT=32-bit_rle_rgbe") == 0) valid = 1;
+// float to half with round-to-nearest-even, for non-negative finite input.
+// anything too large for a half saturates to 65504 instead of going to
+// infinity, since these end up in textures. (after Fabian Giesen's
+// float_to_half_fast3_rtne)
+static stbi__uint16 stbi__float_to_half(float f)
+{
+	stbi__fp32 x, denorm_magic;
+	x.f = f;
+	if (x.u >= (127 + 16) << 23)
+		return 0x7bff;
+	if (x.u < 113 << 23) {
+		// result is subnormal or zero; let the FPU do the rounding
+		denorm_magic.u = ((127 - 15) + (23 - 10) + 1) << 23;
+		x.f += denorm_magic.f;
+		return (stbi__uint16)(x.u - denorm_magic.u);
 	}
+	x.u += ((stbi__uint32)(15 - 127) << 23) + 0xfff + ((x.u >> 13) & 1);
+	return (stbi__uint16)(x.u >> 13);
+}
 
-	if (!valid)    return stbi__errpf("unsupported format", "Unsupported HDR format");
-
-	// Parse width and height
-	// can't use sscanf() if we're not using stdio!
-	token = stbi__hdr_gettoken(s, buffer);
-	if (strncmp(token, "-Y ", 3))  return stbi__errpf("unsupported data layout", "Unsupported HDR format");
-	token += 3;
-	height = (int)strtol(token, &token, 10);
-	while (*token == ' ') ++token;
-	if (strncmp(token, "+X ", 3))  return stbi__errpf("unsupported data layout", "Unsupported HDR format");
-	token += 3;
-	width = (int)strtol(token, NULL, 10);
-
-	*x = width;
-	*y = height;
-
-	if (comp)* comp = 3;
-	if (req_comp == 0) req_comp = 3;
+// 2^(e-136), the weight of one mantissa step for RGBE exponent e. exponents
+// below 10 would be float denormals; they're far below half/rgb9e5 range, so
+// just treat them as zero
+static float stbi__hdr_scale(int e)
+{
+	stbi__fp32 scale;
+	scale.u = e >= 10 ? (stbi__uint32)(e - 9) << 23 : 0;
+	return scale.f;
+}
 
-	if (!stbi__mad4sizes_valid(width, height, req_comp, sizeof(float), 0))
-		return stbi__errpf("too large", "HDR image is too large");
+static void stbi__hdr_convert_half(stbi__uint16* output, stbi_uc* input)
+{
+	float scale = stbi__hdr_scale(input[3]);
+	output[0] = stbi__float_to_half(input[0] * scale);
+	output[1] = stbi__float_to_half(input[1] * scale);
+	output[2] = stbi__float_to_half(input[2] * scale);
+	output[3] = 0x3c00; // 1.0
+}
 
-	// Read data
-	hdr_data = (float*)stbi__malloc_mad4(width, height, req_comp, sizeof(float), 0);
-	if (!hdr_data)
-		return stbi__errpf("outofmem", "Out of memory");
+static stbi__uint32 stbi__rgb9e5_saturate(stbi__uint32 v, int shift)
+{
+	if (v == 0) return 0;
+	return (shift >= 9 || (v << shift) > 511) ? 511 : v << shift;
+}
 
-	// Load image data
-	// image data is stored as some number of sca
-	if (width < 8 || width >= 32768) {
-		// Read flat data
-		for (j = 0; j < height; ++j) {
-			for (i = 0; i < width; ++i) {
-				stbi_uc rgbe[4];
-			main_decode_loop:
-				stbi__getn(s, rgbe, 4);
-				stbi__hdr_convert(hdr_data + j * width * req_comp + i * req_comp, rgbe, req_comp);
-			}
-		}
+// RGBE already shares one exponent between the channels, so this is just a
+// rebias: mantissa m*2^(e-136) == (m*2)*2^((e-113)-15-9) for RGB9E5
+static stbi__uint32 stbi__hdr_convert_rgb9e5(stbi_uc* input)
+{
+	int e = input[3] - 113;
+	stbi__uint32 r = input[0] << 1, g = input[1] << 1, b = input[2] << 1;
+	if (input[3] == 0)
+		return 0;
+	if (e > 31) {
+		// too bright; clamp each channel to the largest representable value
+		r = stbi__rgb9e5_saturate(r, e - 31);
+		g = stbi__rgb9e5_saturate(g, e - 31);
+		b = stbi__rgb9e5_saturate(b, e - 31);
+		e = 31;
 	}
-	else {
-		// Read RLE-encoded data
-		scanline = NULL;
-
-		for (j = 0; j < height; ++j) {
-			c1 = stbi__get8(s);
-			c2 = stbi__get8(s);
-			len = stbi__get8(s);
-			if (c1 != 2 || c2 != 2 || (len & 0x80)) {
-				// not run-length encoded, so we have to actually use THIS data as a decoded
-				// pixel (note this can't be a valid pixel--one of RGB must be >= 128)
-				stbi_uc rgbe[4];
-				rgbe[0] = (stbi_uc)c1;
-				rgbe[1] = (stbi_uc)c2;
-				rgbe[2] = (stbi_uc)len;
-				rgbe[3] = (stbi_uc)stbi__get8(s);
-				stbi__hdr_convert(hdr_data, rgbe, req_comp);
-				i = 1;
-				j = 0;
-				STBI_FREE(scanline);
-				goto main_decode_loop; // yes, this makes no sense
-			}
-			len <<= 8;
-			len |= stbi__get8(s);
-			if (len != width) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("invalid decoded scanline length", "corrupt HDR"); }
-			if (scanline == NULL) {
-				scanline = (stbi_uc*)stbi__malloc_mad2(width, 4, 0);
-				if (!scanline) {
-					STBI_FREE(hdr_data);
-					return stbi__errpf("outofmem", "Out of memory");
-				}
-			}
-
-			for (k = 0; k < 4; ++k) {
-				int nleft;
-				i = 0;
-				while ((nleft = width - i) > 0) {
-					count = stbi__get8(s);
-					if (count > 128) {
-						// Run
-						value = stbi__get8(s);
-						count -= 128;
-						if (count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-						for (z = 0; z < count; ++z)
-							scanline[i++ * 4 + k] = value;
-					}
-					else {
-						// Dump
-						if (count > nleft) { STBI_FREE(hdr_data); STBI_FREE(scanline); return stbi__errpf("corrupt", "bad RLE data in HDR"); }
-						for (z = 0; z < count; ++z)
-							scanline[i++ * 4 + k] = stbi__get8(s);
-					}
-				}
-			}
-			for (i = 0; i < width; ++i)
-				stbi__hdr_convert(hdr_data + (j * width + i) * req_comp, scanline + i * 4, req_comp);
-		}
-		if (scanline)
-			STBI_FREE(scanline);
+	else if (e < 0) {
+		// too dark for a normal exponent; denormalize with rounding
+		int shift = -e;
+		if (shift > 9) return 0;
+		r = (r + (1 << (shift - 1))) >> shift;
+		g = (g + (1 << (shift - 1))) >> shift;
+		b = (b + (1 << (shift - 1))) >> shift;
+		e = 0;
 	}
+	return r | (g << 9) | (b << 18) | ((stbi__uint32)e << 27);
+}
 
-	return hdr_data;
+#ifdef STBI_SSE2
+// four lanes of stbi__float_to_half, results in the low 16 bits of each lane
+static __m128i stbi__float_to_half_sse2(__m128 f)
+{
+	__m128i u = _mm_castps_si128(f);
+	__m128i denorm_magic = _mm_set1_epi32(((127 - 15) + (23 - 10) + 1) << 23);
+	__m128i is_small = _mm_cmplt_epi32(u, _mm_set1_epi32(113 << 23));
+	__m128i is_big = _mm_cmpgt_epi32(u, _mm_set1_epi32(((127 + 16) << 23) - 1));
+	__m128i sub = _mm_sub_epi32(_mm_castps_si128(_mm_add_ps(f, _mm_castsi128_ps(denorm_magic))), denorm_magic);
+	__m128i odd = _mm_and_si128(_mm_srli_epi32(u, 13), _mm_set1_epi32(1));
+	__m128i nrm = _mm_add_epi32(u, _mm_set1_epi32(0xfff - (112 << 23)));
+	__m128i r;
+	nrm = _mm_srli_epi32(_mm_add_epi32(nrm, odd), 13);
+	r = _mm_or_si128(_mm_and_si128(is_small, sub), _mm_andnot_si128(is_small, nrm));
+	r = _mm_or_si128(_mm_and_si128(is_big, _mm_set1_epi32(0x7bff)), _mm_andnot_si128(is_big, r));
+	return r;
 }
 
-static int stbi__hdr_info(stbi__context* s, int* x, int* y, int* comp)
+// one RGBE pixel widened to 32-bit lanes -> R,G,B as floats scaled by the exponent
+static __m128 stbi__hdr_rgbe_to_float_sse2(__m128i px)
+{
+	__m128i e = _mm_shuffle_epi32(px, _MM_SHUFFLE(3, 3, 3, 3));
+	__m128i t = _mm_sub_epi32(e, _mm_set1_epi32(9));
+	__m128i scale = _mm_and_si128(_mm_slli_epi32(t, 23), _mm_cmpgt_epi32(t, _mm_setzero_si128()));
+	return _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_castsi128_ps(scale));
+}
+
+static int stbi__hdr_convert_half_row_sse2(stbi__uint16* output, stbi_uc* input, int width)
+{
+	int i = 0;
+	__m128i zero = _mm_setzero_si128();
+	__m128i alpha = _mm_set_epi16(0x3c00, 0, 0, 0, 0x3c00, 0, 0, 0);
+	__m128i rgb_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	for (; i + 4 <= width; i += 4) {
+		__m128i rgbe = _mm_loadu_si128((__m128i*) (input + i * 4));
+		__m128i lo = _mm_unpacklo_epi8(rgbe, zero);
+		__m128i hi = _mm_unpackhi_epi8(rgbe, zero);
+		__m128i p0 = stbi__float_to_half_sse2(stbi__hdr_rgbe_to_float_sse2(_mm_unpacklo_epi16(lo, zero)));
+		__m128i p1 = stbi__float_to_half_sse2(stbi__hdr_rgbe_to_float_sse2(_mm_unpackhi_epi16(lo, zero)));
+		__m128i p2 = stbi__float_to_half_sse2(stbi__hdr_rgbe_to_float_sse2(_mm_unpacklo_epi16(hi, zero)));
+		__m128i p3 = stbi__float_to_half_sse2(stbi__hdr_rgbe_to_float_sse2(_mm_unpackhi_epi16(hi, zero)));
+		// halves are at most 0x7bff, so the signed-saturating pack is exact
+		__m128i o0 = _mm_or_si128(_mm_and_si128(_mm_packs_epi32(p0, p1), rgb_mask), alpha);
+		__m128i o1 = _mm_or_si128(_mm_and_si128(_mm_packs_epi32(p2, p3), rgb_mask), alpha);
+		_mm_storeu_si128((__m128i*) (output + i * 4), o0);
+		_mm_storeu_si128((__m128i*) (output + i * 4 + 8), o1);
+	}
+	return i;
+}
+
+static int stbi__hdr_convert_float_row_sse2(float* output, stbi_uc* input, int width, int req_comp)
+{
+	int i;
+	__m128i zero = _mm_setzero_si128();
+	__m128 rgb_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+	__m128 alpha = _mm_set_ps(1.0f, 0.0f, 0.0f, 0.0f);
+	// 3-component output stores a whole vector per pixel and relies on the next
+	// pixel overwriting the extra lane, so the last pixel is left to the caller
+	int n = (req_comp == 4) ? width : width - 1;
+	for (i = 0; i < n; ++i) {
+		stbi_uc* in = input + i * 4;
+		stbi__uint32 rgbe;
+		__m128 f;
+		if (in[3] != 0 && in[3] < 10) {
+			// needs a denormal scale factor
+			stbi__hdr_convert(output + i * req_comp, in, req_comp);
+			continue;
+		}
+		memcpy(&rgbe, in, 4);
+		f = stbi__hdr_rgbe_to_float_sse2(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)rgbe), zero), zero));
+		if (req_comp == 4)
+			f = _mm_or_ps(_mm_and_ps(f, rgb_mask), alpha);
+		_mm_storeu_ps(output + i * req_comp, f);
+	}
+	return i;
+}
+
+static int stbi__hdr_convert_rgb9e5_row_sse2(stbi__uint32* output, stbi_uc* input, int width)
+{
+	int i = 0;
+	__m128i byte_mask = _mm_set1_epi32(0xff);
+	__m128i e_lo = _mm_set1_epi32(113 - 1);
+	__m128i e_hi = _mm_set1_epi32(113 + 31 + 1);
+	for (; i + 4 <= width; i += 4) {
+		__m128i rgbe = _mm_loadu_si128((__m128i*) (input + i * 4));
+		__m128i e = _mm_srli_epi32(rgbe, 24);
+		__m128i r, g, b, out;
+		// exponents outside [113,144] need clamping or denormalizing, as do
+		// zero pixels; leave groups with any of those to the scalar code
+		__m128i in_range = _mm_and_si128(_mm_cmpgt_epi32(e, e_lo), _mm_cmplt_epi32(e, e_hi));
+		if (_mm_movemask_epi8(in_range) != 0xffff)
+			break;
+		r = _mm_slli_epi32(_mm_and_si128(rgbe, byte_mask), 1);
+		g = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(rgbe, 8), byte_mask), 1 + 9);
+		b = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi32(rgbe, 16), byte_mask), 1 + 18);
+		e = _mm_slli_epi32(_mm_sub_epi32(e, _mm_set1_epi32(113)), 27);
+		out = _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, e));
+		_mm_storeu_si128((__m128i*) (output + i), out);
+	}
+	return i;
+}
+#endif
+
+// convert one decoded RGBE scanline to the requested output format
+static void stbi__hdr_convert_row(void* output, stbi_uc* scanline, int width, int req_comp, int format, int simd)
+{
+	int i = 0;
+	STBI_NOTUSED(simd);
+	switch (format) {
+	case STBI__HDR_float:
+#ifdef STBI_SSE2
+		if (simd && req_comp >= 3) i = stbi__hdr_convert_float_row_sse2((float*)output, scanline, width, req_comp);
+#endif
+		for (; i < width; ++i)
+			stbi__hdr_convert((float*)output + i * req_comp, scanline + i * 4, req_comp);
+		break;
+	case STBI__HDR_half:
+#ifdef STBI_SSE2
+		if (simd) i = stbi__hdr_convert_half_row_sse2((stbi__uint16*)output, scanline, width);
+#endif
+		for (; i < width; ++i)
+			stbi__hdr_convert_half((stbi__uint16*)output + i * 4, scanline + i * 4);
+		break;
+	case STBI__HDR_rgb9e5:
+		while (i < width) {
+#ifdef STBI_SSE2
+			if (simd) i += stbi__hdr_convert_rgb9e5_row_sse2((stbi__uint32*)output + i, scanline + i * 4, width - i);
+			if (i == width) break;
+#endif
+			// one scalar pixel, then retry the vector path
+			((stbi__uint32*)output)[i] = stbi__hdr_convert_rgb9e5(scanline + i * 4);
+			++i;
+		}
+		break;
+	case STBI__HDR_ldr:
+		for (; i < width; ++i) {
+			float f[4];
+			int k, n = (req_comp & 1) ? req_comp : req_comp - 1; // non-alpha components
+			stbi__hdr_convert(f, scanline + i * 4, req_comp);
+			for (k = 0; k < req_comp; ++k)
+				((stbi_uc*)output)[i * req_comp + k] = stbi__hdr_to_ldr_value(f[k], k >= n);
+		}
+		break;
+	}
+}
+
+// read n bytes of flat pixel data. a truncated flat image has always decoded
+// what is there, so the missing bytes read as zero instead of failing the load
+static void stbi__hdr_read_flat(stbi__context* s, stbi_uc* buffer, int n)
+{
+	while (n > 0) {
+		int blen = (int)(s->img_buffer_end - s->img_buffer);
+		if (blen == 0) {
+			*buffer++ = stbi__get8(s); // refills, or 0 past the end
+			--n;
+			continue;
+		}
+		if (blen > n) blen = n;
+		memcpy(buffer, s->img_buffer, blen);
+		s->img_buffer += blen;
+		buffer += blen;
+		n -= blen;
+	}
+}
+
+// read one scanline of RGBE pixels; 'planes' is 4*width bytes of scratch. the
+// first scanline without the RLE marker sets *flat, and the rest of the image
+// is then read uncompressed
+static int stbi__hdr_read_scanline(stbi__context* s, stbi_uc* scanline, stbi_uc* planes, int width, int* flat, int simd)
+{
+	int i, k, c1, c2, len;
+	unsigned char count, value;
+
+	if (*flat) {
+		stbi__hdr_read_flat(s, scanline, width * 4);
+		return 1;
+	}
+
+	c1 = stbi__get8(s);
+	c2 = stbi__get8(s);
+	len = stbi__get8(s);
+	if (c1 != 2 || c2 != 2 || (len & 0x80)) {
+		// not run-length encoded, so we have to actually use THIS data as a decoded
+		// pixel (note this can't be a valid pixel--one of RGB must be >= 128)
+		scanline[0] = (stbi_uc)c1;
+		scanline[1] = (stbi_uc)c2;
+		scanline[2] = (stbi_uc)len;
+		scanline[3] = (stbi_uc)stbi__get8(s);
+		*flat = 1;
+		stbi__hdr_read_flat(s, scanline + 4, (width - 1) * 4);
+		return 1;
+	}
+	len <<= 8;
+	len |= stbi__get8(s);
+	if (len != width) return stbi__err("invalid decoded scanline length", "corrupt HDR");
+
+	for (k = 0; k < 4; ++k) {
+		stbi_uc* plane = planes + k * width;
+		int nleft;
+		i = 0;
+		while ((nleft = width - i) > 0) {
+			count = stbi__get8(s);
+			if (count > 128) {
+				// Run
+				value = stbi__get8(s);
+				count -= 128;
+				if (count > nleft) return stbi__err("corrupt", "bad RLE data in HDR");
+				memset(plane + i, value, count);
+			}
+			else {
+				// Dump; a zero count would never finish the scanline (it is also
+				// what get8 returns past the end of a truncated file)
+				if (count == 0 || count > nleft) return stbi__err("corrupt", "bad RLE data in HDR");
+				if (!stbi__getn(s, plane + i, count)) return stbi__err("corrupt", "truncated HDR data");
+			}
+			i += count;
+		}
+	}
+	stbi__interleave4(scanline, planes, width, width, simd);
+	return 1;
+}
+
+// find where every scanline starts without decoding anything, so they can be
+// decoded independently. fails if the data isn't all RLE or all flat, or is
+// truncated or corrupt; the caller then decodes serially
+static int stbi__hdr_find_scanlines(stbi_uc* p, stbi_uc* end, int width, int height, int* flat, stbi_uc** row_start)
+{
+	int j, k;
+	if (width <= 0) return 0;
+	if (!*flat && end - p >= 4 && (p[0] != 2 || p[1] != 2 || (p[2] & 0x80)))
+		*flat = 1; // first scanline isn't RLE, so none of them are
+	if (*flat) {
+		if ((size_t)(end - p) / 4 / width < (size_t)height) return 0;
+		for (j = 0; j <= height; ++j)
+			row_start[j] = p + (size_t)j * width * 4;
+		return 1;
+	}
+	for (j = 0; j < height; ++j) {
+		row_start[j] = p;
+		if (end - p < 4 || p[0] != 2 || p[1] != 2 || (p[2] & 0x80)) return 0;
+		if (((p[2] << 8) | p[3]) != width) return 0;
+		p += 4;
+		for (k = 0; k < 4; ++k) {
+			int i = 0;
+			while (i < width) {
+				int count;
+				if (p >= end) return 0;
+				count = *p++;
+				if (count > 128) {
+					count -= 128;
+					p += 1;
+				}
+				else
+					p += count;
+				if (count == 0 || count > width - i || p > end) return 0;
+				i += count;
+			}
+		}
+	}
+	row_start[height] = p;
+	return 1;
+}
+
+#define STBI__HDR_MIN_BAND_ROWS  16
+#define STBI__HDR_MAX_BANDS      64
+
+typedef struct
+{
+	stbi_uc* out;
+	stbi_uc* scratch;            // 8*width bytes per band
+	stbi_uc** row_start;         // height+1 entries
+	int width, height, band_rows, flat, flip;
+	int req_comp, format, out_bytes, simd;
+} stbi__hdr_bands;
+
+static void stbi__hdr_decode_band(void* data, int band)
+{
+	stbi__hdr_bands* b = (stbi__hdr_bands*)data;
+	stbi_uc* scanline = b->scratch + (size_t)band * b->width * 8;
+	int j = band * b->band_rows, end = j + b->band_rows, flat = b->flat;
+	if (end > b->height) end = b->height;
+	for (; j < end; ++j) {
+		stbi__context s;
+		int row = b->flip ? b->height - 1 - j : j;
+		stbi__start_mem(&s, b->row_start[j], (int)(b->row_start[j + 1] - b->row_start[j]));
+		// can't fail; stbi__hdr_find_scanlines already walked this data
+		stbi__hdr_read_scanline(&s, scanline, scanline + b->width * 4, b->width, &flat, b->simd);
+		stbi__hdr_convert_row(b->out + (size_t)row * b->width * b->out_bytes, scanline, b->width, b->req_comp, b->format, b->simd);
+	}
+}
+
+// decode bands of scanlines through the user's parallel-for. only possible when
+// the whole file is in memory; returns 0 if the caller should decode serially
+static int stbi__hdr_decode_parallel(stbi__context* s, stbi__hdr_bands* b)
+{
+	int nbands;
+	b->row_start = (stbi_uc**)stbi__malloc(sizeof(stbi_uc*) * ((size_t)b->height + 1));
+	if (!b->row_start) return 0;
+	if (!stbi__hdr_find_scanlines(s->img_buffer, s->img_buffer_end, b->width, b->height, &b->flat, b->row_start)) {
+		stbi__free(b->row_start);
+		return 0;
+	}
+	b->band_rows = STBI__HDR_MIN_BAND_ROWS;
+	if (b->height / b->band_rows >= STBI__HDR_MAX_BANDS)
+		b->band_rows = (b->height + STBI__HDR_MAX_BANDS - 1) / STBI__HDR_MAX_BANDS;
+	nbands = (b->height + b->band_rows - 1) / b->band_rows;
+	b->scratch = (stbi_uc*)stbi__malloc_mad3(nbands, b->width, 8, 0);
+	if (!b->scratch) {
+		stbi__free(b->row_start);
+		return 0;
+	}
+	stbi__parallel_for(stbi__parallel_for_user, stbi__hdr_decode_band, b, nbands);
+	s->img_buffer = b->row_start[b->height];
+	stbi__free(b->scratch);
+	stbi__free(b->row_start);
+	return 1;
+}
+
+static void* stbi__hdr_load_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, int format)
+{
+	char buffer[STBI__HDR_BUFLEN];
+	char* token;
+	int valid = 0;
+	int width, height;
+	stbi_uc* scanline;
+	stbi_uc* hdr_data;
+	int j, flat, out_bytes, simd = 0;
+	const char* headerToken;
+
+	// Check identifier
+	headerToken = stbi__hdr_gettoken(s, buffer);
+	if (strcmp(headerToken, "#?RADIANCE") != 0 && strcmp(headerToken, "#?RGBE") != 0)
+		return stbi__errpuc("not HDR", "Corrupt HDR image");
+
+	// Parse header
+	for (;;) {
+		token = stbi__hdr_gettoken(s, buffer);
+		if (token[0] == 0) break;
+		if (strcmp(token, "FORMAT=32-bit_rle_rgbe") == 0) valid = 1;
+	}
+
+	if (!valid)    return stbi__errpuc("unsupported format", "Unsupported HDR format");
+
+	// Parse width and height
+	// can't use sscanf() if we're not using stdio!
+	token = stbi__hdr_gettoken(s, buffer);
+	if (strncmp(token, "-Y ", 3))  return stbi__errpuc("unsupported data layout", "Unsupported HDR format");
+	token += 3;
+	height = (int)strtol(token, &token, 10);
+	while (*token == ' ') ++token;
+	if (strncmp(token, "+X ", 3))  return stbi__errpuc("unsupported data layout", "Unsupported HDR format");
+	token += 3;
+	width = (int)strtol(token, NULL, 10);
+
+	*x = width;
+	*y = height;
+
+	if (comp)* comp = 3;
+	if (req_comp == 0) req_comp = 3;
+
+	switch (format) {
+	case STBI__HDR_half:   out_bytes = 4 * sizeof(stbi__uint16); break;
+	case STBI__HDR_rgb9e5: out_bytes = sizeof(stbi__uint32); break;
+	case STBI__HDR_ldr:    out_bytes = req_comp; break;
+	default:               out_bytes = req_comp * sizeof(float); break;
+	}
+
+	if (!stbi__mad3sizes_valid(width, height, out_bytes, 0) || !stbi__mad2sizes_valid(width, 8, 0))
+		return stbi__errpuc("too large", "HDR image is too large");
+
+	// Read data
+	if (s->stream) {
+		s->img_x = width;
+		s->img_y = height;
+		hdr_data = stbi__stream_start(s, req_comp, s->flip_vertically);
+	}
+	else
+		hdr_data = (stbi_uc*)stbi__malloc_mad3(width, height, out_bytes, 0);
+	scanline = (stbi_uc*)stbi__malloc_mad2(width, 8, 0);
+	if (!hdr_data || !scanline) {
+		stbi__free_rows(s, hdr_data);
+		stbi__free(scanline);
+		return stbi__errpuc("outofmem", "Out of memory");
+	}
+
+#ifdef STBI_SSE2
+	simd = stbi__sse2_available();
+#endif
+
+	// Load image data
+	// scanlines of width 8..32767 are usually RLE-encoded, everything else is flat
+	flat = (width < 8 || width >= 32768);
+	if (stbi__parallel_for && s->io.read == NULL && width > 0 && height > STBI__HDR_MIN_BAND_ROWS && !s->stream) {
+		stbi__hdr_bands bands;
+		bands.out = hdr_data;
+		bands.width = width;
+		bands.height = height;
+		bands.flat = flat;
+		bands.flip = s->flip_vertically;
+		bands.req_comp = req_comp;
+		bands.format = format;
+		bands.out_bytes = out_bytes;
+		bands.simd = simd;
+		if (stbi__hdr_decode_parallel(s, &bands)) {
+			stbi__free(scanline);
+			return hdr_data;
+		}
+	}
+	for (j = 0; j < height; ++j) {
+		if (!stbi__hdr_read_scanline(s, scanline, scanline + width * 4, width, &flat, simd)) {
+			stbi__free_rows(s, hdr_data);
+			stbi__free(scanline);
+			return NULL;
+		}
+		if (s->stream) {
+			stbi__hdr_convert_row(stbi__stream_row(s), scanline, width, req_comp, format, simd);
+			if (!stbi__stream_put(s)) {
+				stbi__free(scanline);
+				return NULL;
+			}
+		}
+		else
+			stbi__hdr_convert_row(hdr_data + (size_t)stbi__out_row(s, j, height) * width * out_bytes, scanline, width, req_comp, format, simd);
+	}
+	stbi__free(scanline);
+
+	return hdr_data;
+}
+
+static float* stbi__hdr_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
+{
+	STBI_NOTUSED(ri);
+	return (float*)stbi__hdr_load_main(s, x, y, comp, req_comp, STBI__HDR_float);
+}
+
+static void* stbi__hdr_load_packed(stbi__context* s, int* x, int* y, int format)
+{
+	if (!stbi__hdr_test(s))
+		return stbi__errpuc("not HDR", "Image is not a Radiance HDR file");
+	return stbi__hdr_load_main(s, x, y, NULL, 0, format);
+}
+
+static int stbi__hdr_info(stbi__context* s, int* x, int* y, int* comp)
 {
 	char buffer[STBI__HDR_BUFLEN];
 	char* token;
@@ -7049,7 +9721,7 @@ static int stbi__bmp_info(stbi__context* s, int* x, int* y, int* comp)
 	if (p == NULL)
 		return 0;
 	if (x)* x = s->img_x;
-	if (y)* y = s->img_y;
+	if (y)* y = abs((int)s->img_y); // negative for top-down
 	if (comp) {
 		if (info.bpp == 24 && info.ma == 0xff000000)
 			* comp = 3;
@@ -7193,7 +9865,6 @@ static int stbi__pic_info(stbi__context* s, int* x, int* y, int* comp)
 // Known limitations:
 //    Does not support comments in the header section
 //    Does not support ASCII image data (formats P2 and P3)
-//    Does not support 16-bit-per-channel
 
 #ifndef STBI_NO_PNM
 
@@ -7212,24 +9883,48 @@ static int      stbi__pnm_test(stbi__context* s)
 static void* stbi__pnm_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri)
 {
 	stbi_uc* out;
-	STBI_NOTUSED(ri);
+	int j, row_bytes;
+	size_t pitch;
 
-	if (!stbi__pnm_info(s, (int*)& s->img_x, (int*)& s->img_y, (int*)& s->img_n))
+	ri->bits_per_channel = stbi__pnm_info(s, (int*)& s->img_x, (int*)& s->img_y, (int*)& s->img_n);
+	if (ri->bits_per_channel == 0)
 		return 0;
 
 	*x = s->img_x;
 	*y = s->img_y;
 	if (comp)* comp = s->img_n;
 
-	if (!stbi__mad3sizes_valid(s->img_n, s->img_x, s->img_y, 0))
+	if (!stbi__mad4sizes_valid(s->img_n, s->img_x, s->img_y, ri->bits_per_channel / 8, 0))
 		return stbi__errpuc("too large", "PNM too large");
 
-	out = (stbi_uc*)stbi__malloc_mad3(s->img_n, s->img_x, s->img_y, 0);
+	row_bytes = s->img_n * s->img_x * (ri->bits_per_channel / 8);
+	if (s->stream && ri->bits_per_channel == 8) {
+		out = stbi__stream_start(s, s->img_n, s->flip_vertically);
+		if (!out) return stbi__errpuc("outofmem", "Out of memory");
+		for (j = 0; j < (int)s->img_y; ++j) {
+			stbi__getn(s, stbi__stream_row(s), row_bytes);
+			if (!stbi__stream_put(s)) return NULL;
+		}
+		return out;
+	}
+	if (ri->bits_per_channel == 8 && (req_comp == 0 || req_comp == s->img_n)) {
+		out = stbi__alloc_rows(s, s->img_n, 0, &pitch);
+	}
+	else {
+		out = (stbi_uc*)stbi__malloc_mad4(s->img_n, s->img_x, s->img_y, ri->bits_per_channel / 8, 0);
+		pitch = row_bytes;
+	}
 	if (!out) return stbi__errpuc("outofmem", "Out of memory");
-	stbi__getn(s, out, s->img_n * s->img_x * s->img_y);
+	for (j = 0; j < (int)s->img_y; ++j)
+		stbi__getn(s, out + stbi__out_row(s, j, (int)s->img_y) * pitch, row_bytes);
+	if (ri->bits_per_channel == 16)
+		stbi__swap16_from_be((stbi__uint16*)out, out, (size_t)s->img_n * s->img_x * s->img_y);
 
 	if (req_comp && req_comp != s->img_n) {
-		out = stbi__convert_format(out, s->img_n, req_comp, s->img_x, s->img_y);
+		if (ri->bits_per_channel == 16)
+			out = (stbi_uc*)stbi__convert_format16((stbi__uint16*)out, s->img_n, req_comp, s->img_x, s->img_y);
+		else
+			out = stbi__convert_format(out, s->img_n, req_comp, s->img_x, s->img_y);
 		if (out == NULL) return out; // stbi__convert_format frees input on failure
 	}
 	return out;
@@ -7303,66 +9998,114 @@ static int      stbi__pnm_info(stbi__context* s, int* x, int* y, int* comp)
 
 	maxv = stbi__pnm_getinteger(s, &c);  // read max value
 
-	if (maxv > 255)
-		return stbi__err("max value > 255", "PPM image not 8-bit");
+	// returns the bits per channel; 16-bit samples are stored big-endian
+	if (maxv > 65535)
+		return stbi__err("max value > 65535", "PPM image not 8-bit or 16-bit");
+	else if (maxv > 255)
+		return 16;
 	else
+		return 8;
+}
+
+static int      stbi__pnm_is16(stbi__context* s)
+{
+	if (stbi__pnm_info(s, NULL, NULL, NULL) == 16)
 		return 1;
+	stbi__rewind(s);
+	return 0;
+}
+
+// binary PNM is just a text header in front of the raw raster
+static int      stbi__pnm_view(stbi__context* s, size_t len, stbi_view* view)
+{
+	int x, y, comp, bits;
+	size_t offset, row_bytes;
+
+	bits = stbi__pnm_info(s, &x, &y, &comp);
+	if (bits == 0)
+		return 0; // error code already set
+	if (x <= 0 || y <= 0 || !stbi__mad3sizes_valid(x, comp, bits / 8, 0))
+		return stbi__err("bad size", "Corrupt PNM");
+
+	offset = (size_t)(s->img_buffer - s->img_buffer_original);
+	row_bytes = (size_t)x * comp * (bits / 8);
+	if (len < offset || (len - offset) / row_bytes < (size_t)y)
+		return stbi__err("truncated", "Corrupt PNM");
+
+	view->pixels = s->img_buffer_original + offset;
+	view->x = x;
+	view->y = y;
+	view->comp = comp;
+	view->bits_per_channel = bits;
+	view->bytes_per_pixel = comp * (bits / 8);
+	view->row_pitch = (int)row_bytes;
+	view->channel_order = STBI_ORDER_RGB;
+	return 1;
 }
 #endif
 
-static int stbi__info_main(stbi__context* s, int* x, int* y, int* comp)
+// stbi__info_main, also saying which format the image was in
+static int stbi__info_format(stbi__context* s, int* x, int* y, int* comp, int* format)
 {
+	*format = stbi__sniff_format(s);
+	switch (*format) {
 #ifndef STBI_NO_JPEG
-	if (stbi__jpeg_info(s, x, y, comp)) return 1;
+	case STBI__FORMAT_jpeg: if (stbi__jpeg_info(s, x, y, comp)) return 1; break;
 #endif
-
 #ifndef STBI_NO_PNG
-	if (stbi__png_info(s, x, y, comp))  return 1;
+	case STBI__FORMAT_png:  if (stbi__png_info(s, x, y, comp))  return 1; break;
 #endif
-
 #ifndef STBI_NO_GIF
-	if (stbi__gif_info(s, x, y, comp))  return 1;
+	case STBI__FORMAT_gif:  if (stbi__gif_info(s, x, y, comp))  return 1; break;
 #endif
-
 #ifndef STBI_NO_BMP
-	if (stbi__bmp_info(s, x, y, comp))  return 1;
+	case STBI__FORMAT_bmp:  if (stbi__bmp_info(s, x, y, comp))  return 1; break;
 #endif
-
 #ifndef STBI_NO_PSD
-	if (stbi__psd_info(s, x, y, comp))  return 1;
+	case STBI__FORMAT_psd:  if (stbi__psd_info(s, x, y, comp))  return 1; break;
 #endif
-
 #ifndef STBI_NO_PIC
-	if (stbi__pic_info(s, x, y, comp))  return 1;
+	case STBI__FORMAT_pic:  if (stbi__pic_info(s, x, y, comp))  return 1; break;
 #endif
-
 #ifndef STBI_NO_PNM
-	if (stbi__pnm_info(s, x, y, comp))  return 1;
+	case STBI__FORMAT_pnm:  if (stbi__pnm_info(s, x, y, comp))  return 1; break;
 #endif
-
 #ifndef STBI_NO_HDR
-	if (stbi__hdr_info(s, x, y, comp))  return 1;
+	case STBI__FORMAT_hdr:  if (stbi__hdr_info(s, x, y, comp))  return 1; break;
 #endif
+	default: break;
+	}
 
 	// test tga last because it's a crappy test!
 #ifndef STBI_NO_TGA
+	*format = STBI_FORMAT_tga;
 	if (stbi__tga_info(s, x, y, comp))
 		return 1;
 #endif
+	*format = STBI_FORMAT_unknown;
 	return stbi__err("unknown image type", "Image not of any known type, or corrupt");
 }
 
+static int stbi__info_main(stbi__context* s, int* x, int* y, int* comp)
+{
+	int format;
+	return stbi__info_format(s, x, y, comp, &format);
+}
+
 static int stbi__is_16_main(stbi__context* s)
 {
+	switch (stbi__sniff_format(s)) {
 #ifndef STBI_NO_PNG
-	if (stbi__png_is16(s))  return 1;
+	case STBI__FORMAT_png:  return stbi__png_is16(s);
 #endif
-
 #ifndef STBI_NO_PSD
-	if (stbi__psd_is16(s))  return 1;
+	case STBI__FORMAT_psd:  return stbi__psd_is16(s);
 #endif
-
-	return 0;
+#ifndef STBI_NO_PNM
+	case STBI__FORMAT_pnm:  return stbi__pnm_is16(s);
+#endif
+	default: return 0;
+	}
 }
 
 #ifndef STBI_NO_STDIO
@@ -7384,6 +10127,7 @@ STBIDEF int stbi_info_from_file(FILE* f, int* x, int* y, int* comp)
 	stbi__start_file(&s, f);
 	r = stbi__info_main(&s, x, y, comp);
 	fseek(f, pos, SEEK_SET);
+	stbi__stop_callbacks(&s);
 	return r;
 }
 
@@ -7405,36 +10149,1605 @@ STBIDEF int stbi_is_16_bit_from_file(FILE* f)
 	stbi__start_file(&s, f);
 	r = stbi__is_16_main(&s);
 	fseek(f, pos, SEEK_SET);
+	stbi__stop_callbacks(&s);
 	return r;
 }
-#endif // !STBI_NO_STDIO
 
-STBIDEF int stbi_info_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* comp)
+#define STBI__PROBE_BYTES     (16 << 10)
+#define STBI__PROBE_MAX_BYTES (64 << 10)
+
+typedef struct
+{
+	char const* const* filenames;
+	stbi_probe* results;
+	int probe_bytes;
+} stbi__probe_batch;
+
+static int stbi__probe_one(stbi_probe* p, char const* filename, int probe_bytes)
 {
 	stbi__context s;
+	stbi_uc* buffer;
+	FILE* f;
+	int len, ok;
+
+	f = stbi__fopen(filename, "rb");
+	if (!f) return stbi__err("can't fopen", "Unable to open file");
+	buffer = (stbi_uc*)stbi__malloc(probe_bytes);
+	if (!buffer) {
+		fclose(f);
+		return stbi__err("outofmem", "Out of memory");
+	}
+	setvbuf(f, NULL, _IONBF, 0); // read straight into 'buffer', in one go
+	len = (int)fread(buffer, 1, probe_bytes, f);
+	fclose(f);
+
 	stbi__start_mem(&s, buffer, len);
-	return stbi__info_main(&s, x, y, comp);
+	ok = stbi__info_format(&s, &p->x, &p->y, &p->comp, &p->format);
+	if (ok) {
+		stbi__rewind(&s);
+		p->bits_per_channel = p->format == STBI_FORMAT_hdr ? 32 : stbi__is_16_main(&s) ? 16 : 8;
+	}
+	else if (len == probe_bytes) // the file may simply go on past what was read
+		ok = stbi__err("probe too short", "Header not within the bytes probed");
+	stbi__free(buffer);
+	return ok;
 }
 
-STBIDEF int stbi_info_from_callbacks(stbi_io_callbacks const* c, void* user, int* x, int* y, int* comp)
+// one stbi_probe_files task. failure reasons are per thread (given
+// STBI_THREAD_LOCAL), so the one a failing probe just left is this file's
+static void stbi__probe_file(void* data, int index)
 {
-	stbi__context s;
-	stbi__start_callbacks(&s, (stbi_io_callbacks*)c, user);
-	return stbi__info_main(&s, x, y, comp);
+	stbi__probe_batch* b = (stbi__probe_batch*)data;
+	stbi_probe* p = b->results + index;
+	memset(p, 0, sizeof(*p));
+	if (!stbi__probe_one(p, b->filenames[index], b->probe_bytes)) {
+		p->format = STBI_FORMAT_unknown;
+		p->failure_reason = stbi__g_failure_reason;
+	}
 }
 
-STBIDEF int stbi_is_16_bit_from_memory(stbi_uc const* buffer, int len)
+STBIDEF int stbi_probe_files(char const* const* filenames, int count, int probe_bytes, stbi_probe* results)
 {
-	stbi__context s;
-	stbi__start_mem(&s, buffer, len);
-	return stbi__is_16_main(&s);
+	stbi__probe_batch b;
+	int i, ok = 0;
+	b.filenames = filenames;
+	b.results = results;
+	b.probe_bytes = probe_bytes <= 0 ? STBI__PROBE_BYTES : probe_bytes > STBI__PROBE_MAX_BYTES ? STBI__PROBE_MAX_BYTES : probe_bytes;
+	if (stbi__parallel_for && count > 1)
+		stbi__parallel_for(stbi__parallel_for_user, stbi__probe_file, &b, count);
+	else
+		for (i = 0; i < count; ++i)
+			stbi__probe_file(&b, i);
+	for (i = 0; i < count; ++i)
+		ok += results[i].format != STBI_FORMAT_unknown;
+	return ok;
+}
+
+#ifdef STBI_IO_URING
+// stbi_load_batch reading through an io_uring. files are taken in windows of
+// up to STBI__URING_DEPTH reads that fit one of two arenas registered with
+// the ring, so one window is read while the one before it decodes. files
+// over STBI__URING_DIRECT bytes skip the page cache, and a file too big for
+// an arena is a window of its own in its own buffer
+#define STBI__URING_DEPTH    64
+#define STBI__URING_ARENA    (1 << 20)
+#define STBI__URING_DIRECT   (1 << 20)
+#define STBI__URING_ALIGN    4096 // O_DIRECT buffer, offset and length alignment
+
+typedef struct
+{
+	stbi_uc* data;   // NULL if the file couldn't be read
+	stbi_uc* own;    // data's own mapping if it didn't fit the arena
+	size_t own_size;
+	int len, fd;     // fd is -1 once the read has finished
+	int window, direct;
+	int error;       // 1 can't open, 2 too large, 3 read failed
+} stbi__uring_file;
+
+static stbi_uc* stbi__uring_file_data(stbi__uring_file* f, int* len)
+{
+	*len = f->len;
+	if (f->data) return f->data;
+	if (f->error == 1) return stbi__errpuc("can't fopen", "Unable to open file");
+	if (f->error == 2) return stbi__errpuc("too large", "Image file too large");
+	return stbi__errpuc("read error", "Unable to read file");
 }
+#endif
 
-STBIDEF int stbi_is_16_bit_from_callbacks(stbi_io_callbacks const* c, void* user)
+typedef struct
+{
+	stbi_batch_item const* items;
+	stbi_batch_done done;
+	void* user;
+	stbi_uc* loaded; // per item, so tasks never write the same memory
+	int first;       // item of task 0
+#ifdef STBI_IO_URING
+	stbi__uring_file* files; // NULL when reading with stdio
+#endif
+} stbi__batch;
+
+static stbi_uc* stbi__read_file(char const* filename, int* len);
+
+// one stbi_load_batch task
+static void stbi__load_batch_item(void* data, int task)
 {
+	stbi__batch* b = (stbi__batch*)data;
+	int index = b->first + task;
+	stbi_batch_item const* item = b->items + index;
+	stbi_uc const* buffer = item->buffer;
+	stbi_uc* file = NULL, * result = NULL;
 	stbi__context s;
-	stbi__start_callbacks(&s, (stbi_io_callbacks*)c, user);
-	return stbi__is_16_main(&s);
+	int len = item->len, x = 0, y = 0, comp = 0;
+
+	if (item->filename) {
+#ifdef STBI_IO_URING
+		if (b->files)
+			buffer = stbi__uring_file_data(b->files + index, &len);
+		else
+#endif
+			buffer = file = stbi__read_file(item->filename, &len);
+	}
+	if (buffer || !item->filename) {
+		stbi__start_mem(&s, buffer, len);
+		result = stbi__load_and_postprocess_8bit(&s, &x, &y, &comp, item->desired_channels);
+	}
+	stbi__free(file);
+	b->loaded[index] = result != NULL;
+	b->done(b->user, index, result, x, y, comp, result ? NULL : stbi__g_failure_reason);
+}
+
+// decodes items first .. first+count-1
+static void stbi__load_batch_run(stbi__batch* b, int first, int count)
+{
+	int i;
+	b->first = first;
+	if (stbi__parallel_for && count > 1)
+		stbi__parallel_for(stbi__parallel_for_user, stbi__load_batch_item, b, count);
+	else
+		for (i = 0; i < count; ++i)
+			stbi__load_batch_item(b, i);
+}
+
+#ifdef STBI_IO_URING
+typedef struct
+{
+	int fd, fixed; // fixed: the arenas are registered
+	unsigned* sq_head, * sq_tail, * sq_array, sq_mask;
+	unsigned* cq_head, * cq_tail, cq_mask;
+	struct io_uring_sqe* sqes;
+	struct io_uring_cqe* cqes;
+	void* sq_map, * cq_map, * sqes_map;
+	size_t sq_size, cq_size, sqes_size;
+	unsigned queued;   // reads not submitted yet
+	unsigned inflight; // reads submitted and not reaped yet
+	int failed;        // io_uring_enter failed; read the rest by hand
+	stbi_uc* arena;  // both arenas
+} stbi__uring;
+
+typedef struct
+{
+	int first, end; // items
+	int arena, pending;
+} stbi__uring_window;
+
+static void stbi__uring_exit(stbi__uring* r)
+{
+	if (r->arena && r->arena != MAP_FAILED) munmap(r->arena, 2 * STBI__URING_ARENA);
+	if (r->sqes_map && r->sqes_map != MAP_FAILED) munmap(r->sqes_map, r->sqes_size);
+	if (r->cq_map && r->cq_map != MAP_FAILED && r->cq_map != r->sq_map) munmap(r->cq_map, r->cq_size);
+	if (r->sq_map && r->sq_map != MAP_FAILED) munmap(r->sq_map, r->sq_size);
+	close(r->fd);
+}
+
+static int stbi__uring_init(stbi__uring* r)
+{
+	struct io_uring_params p;
+	struct iovec iov[2];
+	char* sq, * cq;
+	memset(r, 0, sizeof(*r));
+	memset(&p, 0, sizeof(p));
+	r->fd = (int)syscall(__NR_io_uring_setup, 2 * STBI__URING_DEPTH, &p);
+	if (r->fd < 0) return 0;
+
+	r->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	r->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	r->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sq_size = r->cq_size = r->sq_size > r->cq_size ? r->sq_size : r->cq_size;
+	r->sq_map = r->cq_map = mmap(NULL, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+	if (r->sq_map != MAP_FAILED && !(p.features & IORING_FEAT_SINGLE_MMAP))
+		r->cq_map = mmap(NULL, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+	r->sqes_map = mmap(NULL, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+	r->arena = (stbi_uc*)mmap(NULL, 2 * STBI__URING_ARENA, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (r->sq_map == MAP_FAILED || r->cq_map == MAP_FAILED || r->sqes_map == MAP_FAILED || r->arena == MAP_FAILED) {
+		stbi__uring_exit(r);
+		return 0;
+	}
+
+	sq = (char*)r->sq_map;
+	cq = (char*)r->cq_map;
+	r->sq_head = (unsigned*)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	r->sq_mask = *(unsigned*)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned*)(sq + p.sq_off.array);
+	r->cq_head = (unsigned*)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	r->cq_mask = *(unsigned*)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	r->sqes = (struct io_uring_sqe*)r->sqes_map;
+
+	// registering pins the arenas once instead of on every read. it can fail
+	// against RLIMIT_MEMLOCK on older kernels; plain reads work then
+	iov[0].iov_base = r->arena;
+	iov[1].iov_base = r->arena + STBI__URING_ARENA;
+	iov[0].iov_len = iov[1].iov_len = STBI__URING_ARENA;
+	r->fixed = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iov, 2) == 0;
+	return 1;
+}
+
+// queues a read of 'len' bytes from the start of fd. arena is the registered
+// buffer holding 'buffer', or -1
+static void stbi__uring_read(stbi__uring* r, int fd, stbi_uc* buffer, unsigned len, int index, int arena)
+{
+	unsigned tail = *r->sq_tail, i = tail & r->sq_mask;
+	struct io_uring_sqe* e = r->sqes + i;
+	memset(e, 0, sizeof(*e));
+	e->opcode = arena >= 0 && r->fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+	e->fd = fd;
+	e->addr = (size_t)buffer;
+	e->len = len;
+	e->buf_index = arena >= 0 ? arena : 0;
+	e->user_data = index;
+	r->sq_array[i] = i;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	++r->queued;
+}
+
+// submits the queued reads and waits for 'wait' completions
+static int stbi__uring_enter(stbi__uring* r, unsigned wait)
+{
+	int n;
+	do n = (int)syscall(__NR_io_uring_enter, r->fd, r->queued, wait, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+	while (n < 0 && errno == EINTR);
+	if (n > 0) {
+		r->queued -= n;
+		r->inflight += n;
+	}
+	if (n < 0) r->failed = 1;
+	return n;
+}
+
+// a read came back with 'res' bytes, or -errno. whatever it didn't read,
+// including O_DIRECT reads the filesystem refused, is read with pread
+static void stbi__uring_done(stbi__uring_file* f, int res)
+{
+	int n = res < 0 ? 0 : res < f->len ? res : f->len;
+	if (n < f->len) {
+#ifdef O_DIRECT
+		if (f->direct) fcntl(f->fd, F_SETFL, fcntl(f->fd, F_GETFL) & ~O_DIRECT);
+#endif
+		while (n < f->len) {
+			ssize_t k = pread(f->fd, f->data + n, f->len - n, n);
+			if (k < 0 && errno == EINTR) continue;
+			if (k < 0) {
+				f->data = NULL;
+				f->error = 3;
+			}
+			if (k <= 0) break;
+			n += (int)k;
+		}
+		f->len = n; // the file shrank
+	}
+	close(f->fd);
+	f->fd = -1;
+}
+
+static void stbi__uring_reap(stbi__uring* r, stbi__uring_file* files, stbi__uring_window* windows)
+{
+	unsigned head = *r->cq_head, tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+	for (; head != tail; ++head) {
+		struct io_uring_cqe* e = r->cqes + (head & r->cq_mask);
+		stbi__uring_file* f = files + e->user_data;
+		stbi__uring_done(f, e->res);
+		--windows[f->window].pending;
+		--r->inflight;
+	}
+	__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// after a ring failure: waits for every submitted read, so none is still
+// writing into a buffer when the rest are read by hand or the arena is
+// reused. reads that were queued but never submitted are left alone. if
+// waiting fails too, retrying still gets there: completions are posted on
+// the way out of any system call
+static void stbi__uring_drain(stbi__uring* r, stbi__uring_file* files, stbi__uring_window* windows)
+{
+	for (;;) {
+		stbi__uring_reap(r, files, windows);
+		if (!r->inflight) break;
+		syscall(__NR_io_uring_enter, r->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+	}
+}
+
+// opens the files of window w from item 'first' on and sends their reads
+static void stbi__uring_open(stbi__uring* r, stbi__batch* b, stbi__uring_window* w, int first, int count)
+{
+	stbi_uc* arena = r->arena + w->arena * STBI__URING_ARENA;
+	size_t used = 0, size;
+	int i, reads = 0;
+	w->first = first;
+	w->pending = 0;
+	for (i = first; i < count && reads < STBI__URING_DEPTH; ++i) {
+		stbi__uring_file* f = b->files + i;
+		struct stat st;
+		if (!b->items[i].filename) continue;
+		if (f->fd < 0) // else opened by the window before, which it didn't fit
+			f->fd = open(b->items[i].filename, O_RDONLY | O_CLOEXEC);
+		if (f->fd < 0) {
+			f->error = 1;
+			continue;
+		}
+		if (fstat(f->fd, &st) != 0 || st.st_size >= INT_MAX) {
+			close(f->fd);
+			f->fd = -1;
+			f->error = 2;
+			continue;
+		}
+		size = ((size_t)st.st_size + STBI__URING_ALIGN - 1) & ~(size_t)(STBI__URING_ALIGN - 1);
+		if (size > STBI__URING_ARENA) {
+			if (used) break;
+			f->own = (stbi_uc*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (f->own == MAP_FAILED) {
+				f->own = NULL;
+				close(f->fd);
+				f->fd = -1;
+				f->error = 3;
+				continue;
+			}
+			f->own_size = size;
+			f->data = f->own;
+		} else {
+			if (used + size > STBI__URING_ARENA) break;
+			f->data = arena + used;
+			used += size;
+		}
+		f->len = (int)st.st_size;
+		f->window = w->arena;
+		if (!f->len) {
+			close(f->fd);
+			f->fd = -1;
+			continue;
+		}
+#ifdef O_DIRECT
+		if (f->len >= STBI__URING_DIRECT)
+			f->direct = fcntl(f->fd, F_SETFL, fcntl(f->fd, F_GETFL) | O_DIRECT) == 0;
+#endif
+		if (r->failed) {
+			stbi__uring_done(f, -1);
+		} else {
+			stbi__uring_read(r, f->fd, f->data, (unsigned)size, i, f->own ? -1 : w->arena);
+			++w->pending;
+		}
+		++reads;
+		if (f->own) {
+			++i;
+			break;
+		}
+	}
+	w->end = i;
+	if (r->queued && !r->failed) stbi__uring_enter(r, 0);
+}
+
+static void stbi__uring_wait(stbi__uring* r, stbi__uring_file* files, stbi__uring_window* windows, stbi__uring_window* w)
+{
+	int i;
+	for (;;) {
+		stbi__uring_reap(r, files, windows);
+		if (!w->pending || r->failed || stbi__uring_enter(r, 1) < 0) break;
+	}
+	if (r->failed) stbi__uring_drain(r, files, windows);
+	for (i = w->first; i < w->end && w->pending; ++i) // never submitted
+		if (files[i].fd >= 0 && files[i].window == w->arena) {
+			stbi__uring_done(files + i, -1);
+			--w->pending;
+		}
+}
+
+// returns 0 if there's no io_uring, to read with stdio instead
+static int stbi__uring_load_batch(stbi__batch* b, int count)
+{
+	stbi__uring r;
+	stbi__uring_window w[2], * cur;
+	int i;
+	if (!stbi__uring_init(&r)) return 0;
+	b->files = (stbi__uring_file*)stbi__malloc_mad2(count, sizeof(stbi__uring_file), 0);
+	if (!b->files) {
+		stbi__uring_exit(&r);
+		return 0;
+	}
+	memset(b->files, 0, count * sizeof(stbi__uring_file));
+	for (i = 0; i < count; ++i)
+		b->files[i].fd = -1;
+
+	w[0].arena = 0;
+	w[1].arena = 1;
+	cur = w;
+	stbi__uring_open(&r, b, cur, 0, count);
+	while (cur->first < count) {
+		stbi__uring_window* next = w + !cur->arena;
+		stbi__uring_open(&r, b, next, cur->end, count);
+		stbi__uring_wait(&r, b->files, w, cur);
+		stbi__load_batch_run(b, cur->first, cur->end - cur->first);
+		for (i = cur->first; i < cur->end; ++i)
+			if (b->files[i].own) {
+				munmap(b->files[i].own, b->files[i].own_size);
+				b->files[i].own = NULL;
+			}
+		cur = next;
+	}
+	stbi__uring_exit(&r);
+	return 1;
+}
+#endif
+
+STBIDEF int stbi_load_batch(stbi_batch_item const* items, int count, stbi_batch_done done, void* user)
+{
+	stbi__batch b;
+	int i, ok = 0;
+	if (count <= 0) return 0;
+	b.items = items;
+	b.done = done;
+	b.user = user;
+	b.loaded = (stbi_uc*)stbi__malloc(count);
+	if (!b.loaded) return stbi__err("outofmem", "Out of memory");
+#ifdef STBI_IO_URING
+	b.files = NULL;
+	if (!stbi__uring_load_batch(&b, count))
+#endif
+		stbi__load_batch_run(&b, 0, count);
+	for (i = 0; i < count; ++i)
+		ok += b.loaded[i];
+#ifdef STBI_IO_URING
+	stbi__free(b.files);
+#endif
+	stbi__free(b.loaded);
+	return ok;
+}
+
+// reads a whole file into memory
+static stbi_uc* stbi__read_file(char const* filename, int* len)
+{
+	stbi_uc* buffer;
+	long size;
+	FILE* f = stbi__fopen(filename, "rb");
+	if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	if (size < 0 || size >= INT_MAX) {
+		fclose(f);
+		return stbi__errpuc("too large", "Image file too large");
+	}
+	buffer = (stbi_uc*)stbi__malloc(size ? size : 1);
+	if (!buffer) {
+		fclose(f);
+		return stbi__errpuc("outofmem", "Out of memory");
+	}
+	*len = (int)fread(buffer, 1, size, f);
+	fclose(f);
+	return buffer;
+}
+
+// 64-bit hash for the decoded-image cache. eight 64-bit lanes take the input
+// a 64-byte stripe at a time, XXH3 style: each adds the product of the two
+// halves of (data ^ key) to itself and the data to its neighbour. the key
+// slides one lane per stripe and the lanes are scrambled every 8 stripes, so
+// moving bytes around changes the hash. the SIMD versions work on two lanes
+// per instruction and give the same hashes
+static const stbi__uint32 stbi__hash_key[32] = // 16 keys, low half first
+{
+	0x4abea221, 0x2cb0f69f, 0x23148989, 0x94170347, 0x609dfe03, 0xdd555950, 0xdeb12800, 0xdbafb150,
+	0x6c442cb6, 0x7e789b2e, 0xc7e4f8c4, 0xf41e5636, 0xf8fba7e4, 0x0959d150, 0x3cdb9eea, 0xa97316f1,
+	0xf9520068, 0x74cd8258, 0xe116868b, 0x55c74a62, 0xa2023cbd, 0xd2f4c799, 0xa37b51b9, 0xdf98cb79,
+	0x524f3905, 0x396f5885, 0x6ca3b276, 0xaf1d5638, 0x5104e85a, 0xa9ffbe6b, 0x9fd533b3, 0x6bd0c51b,
+};
+
+#define STBI__HASH_PRIME  0x9E3779B1u
+
+static stbi__uint64 stbi__hash_read64(stbi_uc const* p)
+{
+	return (stbi__uint64)(p[0] | p[1] << 8 | p[2] << 16 | (stbi__uint32)p[3] << 24)
+		| (stbi__uint64)(p[4] | p[5] << 8 | p[6] << 16 | (stbi__uint32)p[7] << 24) << 32;
+}
+
+static void stbi__hash_stripe(stbi__uint64* acc, stbi_uc const* p, stbi__uint32 const* key)
+{
+	int i;
+	for (i = 0; i < 8; ++i) {
+		stbi__uint64 d = stbi__hash_read64(p + i * 8);
+		stbi__uint64 k = d ^ ((stbi__uint64)key[i * 2 + 1] << 32 | key[i * 2]);
+		acc[i ^ 1] += d;
+		acc[i] += (k & 0xffffffff) * (k >> 32);
+	}
+}
+
+static void stbi__hash_scramble(stbi__uint64* acc)
+{
+	int i;
+	for (i = 0; i < 8; ++i) {
+		stbi__uint64 a = acc[i] ^ acc[i] >> 47;
+		a ^= (stbi__uint64)stbi__hash_key[17 + i * 2] << 32 | stbi__hash_key[16 + i * 2];
+		acc[i] = a * STBI__HASH_PRIME;
+	}
+}
+
+#ifdef STBI_SSE2
+static void stbi__hash_stripes_sse2(stbi__uint64* acc, stbi_uc const* p, size_t stripes)
+{
+	__m128i a[4], prime = _mm_set1_epi32((int)STBI__HASH_PRIME);
+	size_t n;
+	int i;
+	for (i = 0; i < 4; ++i)
+		a[i] = _mm_loadu_si128((__m128i*) (acc + i * 2));
+	for (n = 0; n < stripes; ++n, p += 64) {
+		stbi__uint32 const* key = stbi__hash_key + (n & 7) * 2;
+		for (i = 0; i < 4; ++i) {
+			__m128i d = _mm_loadu_si128((__m128i const*) (p + i * 16));
+			__m128i k = _mm_xor_si128(d, _mm_loadu_si128((__m128i const*) (key + i * 4)));
+			__m128i prod = _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+			a[i] = _mm_add_epi64(a[i], _mm_add_epi64(prod, _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2))));
+		}
+		if ((n & 7) == 7) {
+			for (i = 0; i < 4; ++i) {
+				__m128i v = _mm_xor_si128(a[i], _mm_srli_epi64(a[i], 47));
+				v = _mm_xor_si128(v, _mm_loadu_si128((__m128i const*) (stbi__hash_key + 16 + i * 4)));
+				// 64x32-bit multiply from two 32x32-bit ones
+				a[i] = _mm_add_epi64(_mm_mul_epu32(v, prime), _mm_slli_epi64(_mm_mul_epu32(_mm_srli_epi64(v, 32), prime), 32));
+			}
+		}
+	}
+	for (i = 0; i < 4; ++i)
+		_mm_storeu_si128((__m128i*) (acc + i * 2), a[i]);
+}
+#endif
+
+#ifdef STBI_NEON
+static void stbi__hash_stripes_neon(stbi__uint64* acc, stbi_uc const* p, size_t stripes)
+{
+	uint64x2_t a[4];
+	uint32x2_t prime = vdup_n_u32(STBI__HASH_PRIME);
+	size_t n;
+	int i;
+	for (i = 0; i < 4; ++i)
+		a[i] = vld1q_u64(acc + i * 2);
+	for (n = 0; n < stripes; ++n, p += 64) {
+		stbi__uint32 const* key = stbi__hash_key + (n & 7) * 2;
+		for (i = 0; i < 4; ++i) {
+			uint64x2_t d = vreinterpretq_u64_u8(vld1q_u8(p + i * 16));
+			uint64x2_t k = veorq_u64(d, vreinterpretq_u64_u32(vld1q_u32(key + i * 4)));
+			a[i] = vaddq_u64(a[i], vextq_u64(d, d, 1));
+			a[i] = vmlal_u32(a[i], vmovn_u64(k), vshrn_n_u64(k, 32));
+		}
+		if ((n & 7) == 7) {
+			for (i = 0; i < 4; ++i) {
+				uint64x2_t v = veorq_u64(a[i], vshrq_n_u64(a[i], 47));
+				v = veorq_u64(v, vreinterpretq_u64_u32(vld1q_u32(stbi__hash_key + 16 + i * 4)));
+				a[i] = vaddq_u64(vmull_u32(vmovn_u64(v), prime), vshlq_n_u64(vmull_u32(vshrn_n_u64(v, 32), prime), 32));
+			}
+		}
+	}
+	for (i = 0; i < 4; ++i)
+		vst1q_u64(acc + i * 2, a[i]);
+}
+#endif
+
+static stbi__uint64 stbi__hash64(void const* data, size_t len, stbi__uint64 seed)
+{
+	stbi_uc const* p = (stbi_uc const*)data;
+	stbi__uint64 acc[8], h, m = (stbi__uint64)0x9E3779B9 << 32 | 0x7F4A7C15;
+	stbi_uc last[64];
+	size_t n = 0, stripes = len / 64;
+	int i;
+
+	for (i = 0; i < 8; ++i)
+		acc[i] = ((stbi__uint64)stbi__hash_key[i * 2 + 1] << 32 | stbi__hash_key[i * 2]) + seed;
+#ifdef STBI_SSE2
+	if (stbi__sse2_available()) {
+		stbi__hash_stripes_sse2(acc, p, stripes);
+		n = stripes;
+	}
+#endif
+#ifdef STBI_NEON
+	stbi__hash_stripes_neon(acc, p, stripes);
+	n = stripes;
+#endif
+	for (; n < stripes; ++n) {
+		stbi__hash_stripe(acc, p + n * 64, stbi__hash_key + (n & 7) * 2);
+		if ((n & 7) == 7)
+			stbi__hash_scramble(acc);
+	}
+
+	// the rest, zero-padded, with a key offset no full stripe uses
+	memset(last, 0, sizeof(last));
+	memcpy(last, p + stripes * 64, len % 64);
+	stbi__hash_stripe(acc, last, stbi__hash_key + 16);
+
+	h = seed ^ (stbi__uint64)len * STBI__HASH_PRIME;
+	for (i = 0; i < 8; ++i) {
+		h = (h ^ acc[i]) * m;
+		h ^= h >> 29;
+	}
+	h *= m;
+	return h ^ h >> 32;
+}
+
+// cache files are a 64-byte little-endian header, then the pixels as
+// tightly packed rows:
+//    0  "stbC", version
+//    8  key: source hash, source length, load options, HDR-to-LDR gamma
+//       and scale (as float bits), 8 zero bytes
+//   40  width, height, channels in file
+//   52  checksum of the pixels, rows chained through stbi__hash64 seeds
+#define STBI__CACHE_VERSION  1
+#define STBI__CACHE_HEADER   64
+#define STBI__CACHE_KEY      32
+
+typedef struct
+{
+	stbi_uc* file;   // the source, if it was read from a file
+	stbi_uc key[STBI__CACHE_KEY];
+	char* path;      // the cache file for 'key'
+} stbi__cache;
+
+static void stbi__cache_put32(stbi_uc* p, stbi__uint32 v)
+{
+	p[0] = STBI__BYTECAST(v);
+	p[1] = STBI__BYTECAST(v >> 8);
+	p[2] = STBI__BYTECAST(v >> 16);
+	p[3] = STBI__BYTECAST(v >> 24);
+}
+
+static void stbi__cache_put64(stbi_uc* p, stbi__uint64 v)
+{
+	stbi__cache_put32(p, (stbi__uint32)v);
+	stbi__cache_put32(p + 4, (stbi__uint32)(v >> 32));
+}
+
+static stbi__uint32 stbi__cache_get32(stbi_uc const* p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (stbi__uint32)p[3] << 24;
+}
+
+// 'y' rows of 'row_bytes', 'pitch' apart
+static stbi__uint64 stbi__cache_checksum(stbi_uc const* p, size_t row_bytes, size_t pitch, int y)
+{
+	stbi__uint64 h = 0;
+	int j;
+	for (j = 0; j < y; ++j)
+		h = stbi__hash64(p + pitch * j, row_bytes, h);
+	return h;
+}
+
+// starts 's' on the source in memory and works out the key
+static void stbi__cache_begin_mem(stbi__cache* c, stbi__context* s, stbi_uc const* buffer, int len, int req_comp)
+{
+	stbi__uint32 bits;
+
+	memset(c, 0, sizeof(*c));
+	stbi__start_mem(s, buffer, len);
+
+	stbi__cache_put64(c->key, stbi__hash64(buffer, len, 0));
+	stbi__cache_put32(c->key + 8, (stbi__uint32)len);
+	stbi__cache_put32(c->key + 12, req_comp | (s->flip_vertically != 0) << 8 | (s->unpremultiply != 0) << 9 | (s->de_iphone != 0) << 10);
+	memcpy(&bits, &stbi__h2l_gamma_i, 4);
+	stbi__cache_put32(c->key + 16, bits);
+	memcpy(&bits, &stbi__h2l_scale_i, 4);
+	stbi__cache_put32(c->key + 20, bits);
+}
+
+// reads the source file into memory, then as stbi__cache_begin_mem
+static int stbi__cache_begin(stbi__cache* c, stbi__context* s, char const* filename, int req_comp)
+{
+	int len;
+	stbi_uc* file = stbi__read_file(filename, &len);
+	if (!file) {
+		memset(c, 0, sizeof(*c));
+		return 0;
+	}
+	stbi__cache_begin_mem(c, s, file, len, req_comp);
+	c->file = file;
+	return 1;
+}
+
+// writes the 16 hex digits that name the key
+static void stbi__cache_hex(stbi__cache const* c, char* p)
+{
+	static const char hex[] = "0123456789abcdef";
+	stbi__uint64 h = stbi__hash64(c->key, STBI__CACHE_KEY, 0);
+	int i;
+	for (i = 60; i >= 0; i -= 4)
+		*p++ = hex[(h >> i) & 15];
+}
+
+// "<cache_dir>/<16 hex digits>.stbi"
+static int stbi__cache_path(stbi__cache* c, char const* cache_dir)
+{
+	size_t dir_len = strlen(cache_dir);
+	char* p = c->path = (char*)stbi__malloc(dir_len + 23);
+	if (!p) return stbi__err("outofmem", "Out of memory");
+	memcpy(p, cache_dir, dir_len);
+	p += dir_len;
+	if (dir_len && cache_dir[dir_len - 1] != '/' && cache_dir[dir_len - 1] != '\\')
+		*p++ = '/';
+	stbi__cache_hex(c, p);
+	strcpy(p + 16, ".stbi");
+	return 1;
+}
+
+static void stbi__cache_end(stbi__cache* c)
+{
+	stbi__free(c->file);
+	stbi__free(c->path);
+}
+
+// opens the cache file for 'c' if its header matches, leaving it at the
+// pixels
+static FILE* stbi__cache_lookup(stbi__cache* c, int req_comp, int* x, int* y, int* comp, stbi__uint64* checksum)
+{
+	stbi_uc h[STBI__CACHE_HEADER];
+	stbi__uint32 w, ht, n;
+	FILE* f = stbi__fopen(c->path, "rb");
+	if (!f) return NULL;
+	if (fread(h, 1, STBI__CACHE_HEADER, f) != STBI__CACHE_HEADER || memcmp(h, "stbC", 4) != 0
+		|| stbi__cache_get32(h + 4) != STBI__CACHE_VERSION || memcmp(h + 8, c->key, STBI__CACHE_KEY) != 0) {
+		fclose(f);
+		return NULL;
+	}
+	w = stbi__cache_get32(h + 40);
+	ht = stbi__cache_get32(h + 44);
+	n = stbi__cache_get32(h + 48);
+	if (w - 1 >= (1 << 24) || ht - 1 >= (1 << 24) || n - 1 >= 4
+		|| !stbi__mad3sizes_valid((int)w, (int)ht, req_comp ? req_comp : (int)n, 0)) {
+		fclose(f);
+		return NULL;
+	}
+	*x = (int)w;
+	*y = (int)ht;
+	*comp = (int)n;
+	*checksum = stbi__hash_read64(h + 52);
+	return f;
+}
+
+// reads the pixels of a cache file into rows 'pitch' apart and closes it.
+// returns 1 if they are all there and match 'checksum'
+static int stbi__cache_read(FILE* f, stbi_uc* p, size_t row_bytes, size_t pitch, int y, stbi__uint64 checksum)
+{
+	int ok = p != NULL, j;
+	if (ok && pitch == row_bytes)
+		ok = fread(p, row_bytes, y, f) == (size_t)y;
+	else
+		for (j = 0; ok && j < y; ++j)
+			ok = fread(p + pitch * j, 1, row_bytes, f) == row_bytes;
+	fclose(f);
+	return ok && stbi__cache_checksum(p, row_bytes, pitch, y) == checksum;
+}
+
+#ifdef _WIN32
+STBI_EXTERN __declspec(dllimport) unsigned long __stdcall GetCurrentProcessId(void);
+STBI_EXTERN __declspec(dllimport) int __stdcall MoveFileExA(const char* existing, const char* replacement, unsigned long flags);
+#define stbi__cache_pid()  ((stbi__uint32)GetCurrentProcessId())
+#else
+#define stbi__cache_pid()  ((stbi__uint32)getpid())
+#endif
+
+// counts temporary files written by this process
+static volatile long stbi__cache_temp_count;
+
+// "<path>.<pid>-<count>.tmp", in hex: unique to this write, so threads and
+// processes caching the same image never write the same temporary file
+static char* stbi__cache_temp_name(char const* path)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t len = strlen(path);
+	char* temp = (char*)stbi__malloc(len + 23);
+	stbi__uint32 id[2];
+	char* p;
+	int i, k;
+	if (!temp) return NULL;
+#if defined(_MSC_VER)
+	id[1] = (stbi__uint32)_InterlockedIncrement(&stbi__cache_temp_count);
+#elif defined(__GNUC__)
+	id[1] = (stbi__uint32)__sync_add_and_fetch(&stbi__cache_temp_count, 1);
+#else
+	id[1] = (stbi__uint32)++stbi__cache_temp_count; // one writer at a time
+#endif
+	id[0] = stbi__cache_pid();
+	memcpy(temp, path, len);
+	p = temp + len;
+	for (k = 0; k < 2; ++k) {
+		*p++ = k ? '-' : '.';
+		for (i = 28; i >= 0; i -= 4)
+			*p++ = hex[(id[k] >> i) & 15];
+	}
+	strcpy(p, ".tmp");
+	return temp;
+}
+
+// stores a decoded image for 'c', as best it can. it goes to a temporary
+// file that is renamed when complete, so nobody reads half a cache file. the
+// rename replaces any file already there: writers of one key write the same
+// image, so whichever finishes last wins and the entry is never missing
+static void stbi__cache_write(stbi__cache* c, stbi_uc const* p, size_t row_bytes, size_t pitch, int x, int y, int comp)
+{
+	stbi_uc h[STBI__CACHE_HEADER];
+	char* temp = stbi__cache_temp_name(c->path);
+	int ok, j;
+	FILE* f;
+
+	if (!temp) return;
+	memset(h, 0, sizeof(h));
+	memcpy(h, "stbC", 4);
+	stbi__cache_put32(h + 4, STBI__CACHE_VERSION);
+	memcpy(h + 8, c->key, STBI__CACHE_KEY);
+	stbi__cache_put32(h + 40, x);
+	stbi__cache_put32(h + 44, y);
+	stbi__cache_put32(h + 48, comp);
+	stbi__cache_put64(h + 52, stbi__cache_checksum(p, row_bytes, pitch, y));
+
+	f = stbi__fopen(temp, "wb");
+	if (f) {
+		ok = fwrite(h, 1, sizeof(h), f) == sizeof(h);
+		for (j = 0; ok && j < y; ++j)
+			ok = fwrite(p + pitch * j, 1, row_bytes, f) == row_bytes;
+		ok = fclose(f) == 0 && ok;
+		// rename() won't replace a file on Windows. if the rename fails
+		// anyway (a reader has the file open there), keep the entry that is
+		// there; it holds the same image
+#ifdef _WIN32
+		if (ok) ok = MoveFileExA(temp, c->path, 1 /* MOVEFILE_REPLACE_EXISTING */) != 0;
+#else
+		if (ok) ok = rename(temp, c->path) == 0;
+#endif
+		if (!ok)
+			remove(temp);
+	}
+	stbi__free(temp);
+}
+
+static stbi_uc* stbi__load_cached_main(stbi__cache* c, stbi__context* s, char const* cache_dir, int* x, int* y, int* comp, int req_comp)
+{
+	stbi__uint64 checksum;
+	stbi_uc* result = NULL;
+	size_t row_bytes;
+	int w, h, n;
+	FILE* f;
+
+	if (stbi__cache_path(c, cache_dir)) {
+		f = stbi__cache_lookup(c, req_comp, &w, &h, &n, &checksum);
+		if (f) {
+			row_bytes = (size_t)w * (req_comp ? req_comp : n);
+			result = (stbi_uc*)stbi__malloc_mad3(w, h, req_comp ? req_comp : n, 0);
+			if (!stbi__cache_read(f, result, row_bytes, row_bytes, h, checksum)) {
+				stbi__free(result);
+				result = NULL;
+			}
+		}
+		if (!result) {
+			result = stbi__load_and_postprocess_8bit(s, &w, &h, &n, req_comp);
+			if (result) {
+				row_bytes = (size_t)w * (req_comp ? req_comp : n);
+				stbi__cache_write(c, result, row_bytes, row_bytes, w, h, n);
+			}
+		}
+		if (result) {
+			*x = w;
+			*y = h;
+			if (comp) *comp = n;
+		}
+	}
+	stbi__cache_end(c);
+	return result;
+}
+
+STBIDEF stbi_uc* stbi_load_cached(char const* filename, char const* cache_dir, int* x, int* y, int* comp, int req_comp)
+{
+	stbi__cache c;
+	stbi__context s;
+	if (!stbi__cache_begin(&c, &s, filename, req_comp)) {
+		stbi__cache_end(&c);
+		return NULL;
+	}
+	return stbi__load_cached_main(&c, &s, cache_dir, x, y, comp, req_comp);
+}
+
+STBIDEF stbi_uc* stbi_load_cached_from_memory(stbi_uc const* buffer, int len, char const* cache_dir, int* x, int* y, int* comp, int req_comp)
+{
+	stbi__cache c;
+	stbi__context s;
+	stbi__cache_begin_mem(&c, &s, buffer, len, req_comp);
+	return stbi__load_cached_main(&c, &s, cache_dir, x, y, comp, req_comp);
+}
+
+static int stbi__load_into_cached_main(stbi__cache* c, stbi__context* s, char const* cache_dir, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	stbi__uint64 checksum;
+	size_t row_bytes, pitch;
+	int result = 0, w, h, n;
+	FILE* f;
+
+	if (stbi__cache_path(c, cache_dir) && stbi__set_target(s, target)) {
+		f = stbi__cache_lookup(c, req_comp, &w, &h, &n, &checksum);
+		if (f) {
+			// an image that doesn't fit is left to the decode to report
+			row_bytes = (size_t)w * (req_comp ? req_comp : n);
+			pitch = stbi__target_pitch(s, row_bytes);
+			result = stbi__cache_read(f, stbi__target_fits(s, row_bytes, 0, h) ? s->target : NULL, row_bytes, pitch, h, checksum);
+		}
+		if (!result) {
+			result = stbi__load_into_main(s, target, &w, &h, &n, req_comp);
+			if (result) {
+				row_bytes = (size_t)w * (req_comp ? req_comp : n);
+				stbi__cache_write(c, s->target, row_bytes, stbi__target_pitch(s, row_bytes), w, h, n);
+			}
+		}
+		if (result) {
+			*x = w;
+			*y = h;
+			if (comp) *comp = n;
+		}
+	}
+	stbi__cache_end(c);
+	return result;
+}
+
+STBIDEF int stbi_load_into_cached(char const* filename, char const* cache_dir, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	stbi__cache c;
+	stbi__context s;
+	if (!stbi__cache_begin(&c, &s, filename, req_comp)) {
+		stbi__cache_end(&c);
+		return 0;
+	}
+	return stbi__load_into_cached_main(&c, &s, cache_dir, target, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_into_cached_from_memory(stbi_uc const* buffer, int len, char const* cache_dir, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	stbi__cache c;
+	stbi__context s;
+	stbi__cache_begin_mem(&c, &s, buffer, len, req_comp);
+	return stbi__load_into_cached_main(&c, &s, cache_dir, target, x, y, comp, req_comp);
+}
+
+#ifdef STBI_SHARED_CACHE
+#ifdef _WIN32
+// named file mappings aren't implemented yet, so on Windows every image is
+// decoded into private memory, as when an image can't be shared elsewhere
+STBIDEF int stbi_load_shared(char const* filename, char const* cache_name, stbi_shared_image* image, int req_comp)
+{
+	STBI_NOTUSED(cache_name);
+	memset(image, 0, sizeof(*image));
+	image->pixels = stbi_load(filename, &image->x, &image->y, &image->channels_in_file, req_comp);
+	image->channels = req_comp ? req_comp : image->channels_in_file;
+	return image->pixels != NULL;
+}
+
+STBIDEF void stbi_release_shared(stbi_shared_image* image)
+{
+	stbi_image_free((void*)image->pixels);
+	memset(image, 0, sizeof(*image));
+}
+#else
+// a shared image is this header, padded so the pixels start on a page
+// boundary whatever the page size, then the packed pixels
+#define STBI__SHARED_HEADER  65536
+#define STBI__SHARED_DEAD    0x80000000u // in 'refs': being taken down
+#define STBI__SHARED_WAIT    10000       // ms to wait for another process's decode
+
+typedef struct
+{
+	char magic[4];               // "stbS"
+	volatile stbi__uint32 ready; // set once the pixels are complete
+	volatile stbi__uint32 refs;  // loads using it
+	stbi__uint32 owner;          // decoding process, where flock can't tell
+	stbi_uc key[STBI__CACHE_KEY];
+	stbi__uint32 x, y, comp, n;
+} stbi__shared_header;
+
+// compare-and-swap with a full barrier, returning the old value
+#define stbi__shared_cas(p, expect, value)  __sync_val_compare_and_swap(p, expect, value)
+
+// "/<cache_name>-<16 hex digits>"
+static char* stbi__shared_name(stbi__cache const* c, char const* cache_name)
+{
+	size_t len = strlen(cache_name);
+	char* name = (char*)stbi__malloc(len + 19);
+	char* p = name;
+	if (!name) return NULL;
+	*p++ = '/';
+	memcpy(p, cache_name, len);
+	p[len] = '-';
+	stbi__cache_hex(c, p + len + 1);
+	p[len + 17] = 0;
+	return name;
+}
+
+static void stbi__shared_sleep(void)
+{
+	struct timespec ms = { 0, 1000000 };
+	nanosleep(&ms, NULL);
+}
+
+// maps the shared image of 'size' bytes called image->name, creating it if
+// it doesn't exist yet. '*created' says which happened. the creator holds an
+// exclusive flock on '*fd' until it publishes the image, so the others can
+// tell whether it is still alive; close '*fd' once done with that
+static stbi__shared_header* stbi__shared_map(stbi_shared_image* image, size_t size, int* created, int* fd_out)
+{
+	struct stat st;
+	void* p;
+	int wait = 0;
+	int fd = shm_open(image->name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	*created = fd >= 0;
+	if (fd < 0 && errno == EEXIST)
+		fd = shm_open(image->name, O_RDWR, 0600);
+	if (fd < 0) return NULL;
+	if (*created) {
+		// locked before it is sized: whoever sees the size sees the lock
+		flock(fd, LOCK_EX);
+#ifdef __linux__
+		// reserve the pages now: running out of shared memory later would
+		// be SIGBUS while decoding instead of an error here
+		if (posix_fallocate(fd, 0, (off_t)size) != 0) {
+#else
+		if (ftruncate(fd, (off_t)size) != 0) {
+#endif
+			shm_unlink(image->name);
+			close(fd);
+			return NULL;
+		}
+	}
+	else {
+		// its creator sizes it right after creating it
+		while (fstat(fd, &st) == 0 && st.st_size == 0 && wait++ < 100)
+			stbi__shared_sleep();
+		if (fstat(fd, &st) != 0 || (size_t)st.st_size != size) {
+			close(fd);
+			return NULL;
+		}
+	}
+	p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) {
+		if (*created) shm_unlink(image->name);
+		close(fd);
+		return NULL;
+	}
+	*fd_out = fd;
+	image->mapping = p;
+	image->mapping_size = size;
+	return (stbi__shared_header*)p;
+}
+
+static void stbi__shared_unmap(stbi_shared_image* image)
+{
+	munmap(image->mapping, image->mapping_size);
+	image->mapping = NULL;
+}
+
+// removes the name, so the next load creates a new image
+static void stbi__shared_unlink(stbi_shared_image* image)
+{
+	shm_unlink(image->name);
+}
+
+// makes this process's view of the pixels read-only
+static void stbi__shared_protect(stbi_shared_image* image)
+{
+	stbi_uc* pixels = (stbi_uc*)image->mapping + STBI__SHARED_HEADER;
+	mprotect(pixels, image->mapping_size - STBI__SHARED_HEADER, PROT_READ);
+}
+
+// whether the process decoding an unpublished image has died: its flock
+// goes away with it. where shared memory can't be flocked, ask for the
+// process id instead, which only works within one pid namespace
+static int stbi__shared_owner_gone(stbi__shared_header* h, int fd)
+{
+	if (flock(fd, LOCK_SH | LOCK_NB) == 0) {
+		flock(fd, LOCK_UN);
+		return 1;
+	}
+	if (errno == EWOULDBLOCK) return 0;
+	return h->owner && kill((pid_t)h->owner, 0) != 0 && errno == ESRCH;
+}
+
+// takes a reference to an image another process published. returns -1 if
+// it is still being decoded, 0 if it can't be used. one whose decoding
+// process died before publishing is unlinked for the next load
+static int stbi__shared_acquire(stbi__shared_header* h, stbi_shared_image* image, stbi__cache const* c, int fd)
+{
+	stbi__uint32 r;
+	if (stbi__shared_cas(&h->ready, 1, 1) != 1) {
+		if (h->refs & STBI__SHARED_DEAD) return 0; // the decode failed
+		if (!stbi__shared_owner_gone(h, fd)) return -1;
+		// it lets go of the lock once it has published, so look again
+		if (stbi__shared_cas(&h->ready, 1, 1) != 1) {
+			shm_unlink(image->name);
+			return 0;
+		}
+	}
+	if (memcmp(h->magic, "stbS", 4) != 0 || memcmp(h->key, c->key, STBI__CACHE_KEY) != 0
+		|| (size_t)h->x * h->y * h->n + STBI__SHARED_HEADER != image->mapping_size)
+		return 0;
+	do {
+		r = h->refs;
+		if (r & STBI__SHARED_DEAD) return 0;
+	} while (stbi__shared_cas(&h->refs, r, r + 1) != r);
+	return 1;
+}
+
+STBIDEF int stbi_load_shared(char const* filename, char const* cache_name, stbi_shared_image* image, int req_comp)
+{
+	stbi__cache c;
+	stbi__context s;
+	stbi__shared_header* h = NULL;
+	stbi_target target;
+	int x, y, comp, created = 0, ok = 0, wait, fd = -1;
+
+	memset(image, 0, sizeof(*image));
+	if (!stbi__cache_begin(&c, &s, filename, req_comp)) {
+		stbi__cache_end(&c);
+		return 0;
+	}
+	image->name = stbi__shared_name(&c, cache_name);
+	if (image->name && stbi__info_main(&s, &x, &y, &comp) && stbi__mad3sizes_valid(x, y, req_comp ? req_comp : comp, STBI__SHARED_HEADER))
+		h = stbi__shared_map(image, (size_t)x * y * (req_comp ? req_comp : comp) + STBI__SHARED_HEADER, &created, &fd);
+	stbi__rewind(&s);
+
+	if (h && created) {
+		// decode straight into the shared pages, then publish them
+		memcpy(h->magic, "stbS", 4);
+		memcpy(h->key, c.key, STBI__CACHE_KEY);
+		h->refs = 1;
+		h->owner = (stbi__uint32)getpid();
+		memset(&target, 0, sizeof(target));
+		target.pixels = (stbi_uc*)h + STBI__SHARED_HEADER;
+		target.size = image->mapping_size - STBI__SHARED_HEADER;
+		ok = stbi__load_into_main(&s, &target, &image->x, &image->y, &image->channels_in_file, req_comp)
+			&& image->x == x && image->y == y && (req_comp || image->channels_in_file == comp);
+		if (ok) {
+			h->x = x;
+			h->y = y;
+			h->comp = image->channels_in_file;
+			h->n = req_comp ? req_comp : image->channels_in_file;
+			stbi__shared_cas(&h->ready, 0, 1);
+		}
+		else {
+			// not published, so nobody else holds it
+			h->refs = STBI__SHARED_DEAD;
+			stbi__shared_unlink(image);
+		}
+	}
+	else if (h) {
+		for (wait = 0; (ok = stbi__shared_acquire(h, image, &c, fd)) < 0 && wait < STBI__SHARED_WAIT; ++wait)
+			stbi__shared_sleep();
+		ok = ok > 0;
+		if (ok) {
+			image->x = h->x;
+			image->y = h->y;
+			image->channels_in_file = h->comp;
+		}
+	}
+	if (fd >= 0) close(fd); // releases the creator's lock
+
+	if (ok) {
+		image->pixels = (stbi_uc*)h + STBI__SHARED_HEADER;
+		stbi__shared_protect(image);
+	}
+	else {
+		if (h) stbi__shared_unmap(image);
+		stbi__rewind(&s);
+		image->pixels = stbi__load_and_postprocess_8bit(&s, &image->x, &image->y, &image->channels_in_file, req_comp);
+		ok = image->pixels != NULL;
+	}
+	image->channels = req_comp ? req_comp : image->channels_in_file;
+	stbi__cache_end(&c);
+	if (!ok) {
+		stbi__free(image->name);
+		image->name = NULL;
+	}
+	return ok;
+}
+
+STBIDEF void stbi_release_shared(stbi_shared_image* image)
+{
+	stbi__shared_header* h = (stbi__shared_header*)image->mapping;
+	stbi__uint32 r;
+	if (h) {
+		do r = h->refs;
+		while (stbi__shared_cas(&h->refs, r, r - 1) != r);
+		// the last one out takes the image down, unless another load took
+		// it again in between
+		if (r == 1 && stbi__shared_cas(&h->refs, 0, STBI__SHARED_DEAD) == 0)
+			stbi__shared_unlink(image);
+		stbi__shared_unmap(image);
+	}
+	else
+		stbi_image_free((void*)image->pixels);
+	stbi__free(image->name);
+	memset(image, 0, sizeof(*image));
+}
+#endif // _WIN32
+#endif // STBI_SHARED_CACHE
+#endif // !STBI_NO_STDIO
+
+STBIDEF int stbi_info_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* comp)
+{
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	return stbi__info_main(&s, x, y, comp);
+}
+
+STBIDEF int stbi_info_from_callbacks(stbi_io_callbacks const* c, void* user, int* x, int* y, int* comp)
+{
+	int result;
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks*)c, user);
+	result = stbi__info_main(&s, x, y, comp);
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
+STBIDEF int stbi_is_16_bit_from_memory(stbi_uc const* buffer, int len)
+{
+	stbi__context s;
+	stbi__start_mem(&s, buffer, len);
+	return stbi__is_16_main(&s);
+}
+
+STBIDEF int stbi_is_16_bit_from_callbacks(stbi_io_callbacks const* c, void* user)
+{
+	int result;
+	stbi__context s;
+	stbi__start_callbacks(&s, (stbi_io_callbacks*)c, user);
+	result = stbi__is_16_main(&s);
+	stbi__stop_callbacks(&s);
+	return result;
+}
+
+// decoder contexts: the entry points below install the decoder for errors and
+// allocations made on this thread, and copy its options into the context
+static stbi_decoder* stbi__decoder_begin(stbi_decoder* d)
+{
+	stbi_decoder* prev = stbi__active_decoder;
+	// memory from malloc_fn must go back to free_fn; realloc_fn is optional
+	STBI_ASSERT(!d->allocator.malloc_fn == !d->allocator.free_fn);
+	STBI_ASSERT(d->allocator.malloc_fn || !d->allocator.realloc_fn);
+	stbi__active_decoder = d;
+	return prev;
+}
+
+static void stbi__decoder_end(stbi_decoder* prev)
+{
+	stbi__active_decoder = prev;
+}
+
+static void stbi__decoder_options(stbi__context* s, stbi_decoder const* d)
+{
+	s->flip_vertically = d->flip_vertically;
+	s->unpremultiply = d->unpremultiply;
+	s->de_iphone = d->convert_iphone_png;
+}
+
+static void stbi__decoder_start_mem(stbi__context* s, stbi_decoder const* d, stbi_uc const* buffer, int len)
+{
+	stbi__start_mem(s, buffer, len);
+	stbi__decoder_options(s, d);
+}
+
+static void stbi__decoder_start_callbacks(stbi__context* s, stbi_decoder const* d, stbi_io_callbacks const* c, void* user)
+{
+	stbi__start_callbacks_buffered(s, (stbi_io_callbacks*)c, user, d->read_ahead);
+	stbi__decoder_options(s, d);
+}
+
+STBIDEF stbi_uc* stbi_decoder_load_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, int* x, int* y, int* comp, int req_comp)
+{
+	stbi_uc* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_mem(&s, d, buffer, len);
+	result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF stbi_uc* stbi_decoder_load_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* comp, int req_comp)
+{
+	stbi_uc* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, clbk, user);
+	result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF int stbi_decoder_load_into_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_mem(&s, d, buffer, len);
+	result = stbi__load_into_main(&s, target, x, y, comp, req_comp);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF int stbi_decoder_load_into_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, clbk, user);
+	result = stbi__load_into_main(&s, target, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF int stbi_decoder_stream_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_mem(&s, d, buffer, len);
+	result = stbi__stream_main(&s, sink, user, band_rows, x, y, comp, req_comp);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF int stbi_decoder_stream_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, stbi_row_sink sink, void* sink_user, int band_rows, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, clbk, user);
+	result = stbi__stream_main(&s, sink, sink_user, band_rows, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF stbi_us* stbi_decoder_load_16_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, int* x, int* y, int* comp, int req_comp)
+{
+	stbi_us* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_mem(&s, d, buffer, len);
+	result = stbi__load_and_postprocess_16bit(&s, x, y, comp, req_comp);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF stbi_us* stbi_decoder_load_16_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* comp, int req_comp)
+{
+	stbi_us* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, clbk, user);
+	result = stbi__load_and_postprocess_16bit(&s, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+#ifndef STBI_NO_LINEAR
+STBIDEF float* stbi_decoder_loadf_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, int* x, int* y, int* comp, int req_comp)
+{
+	float* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_mem(&s, d, buffer, len);
+	result = stbi__loadf_main(&s, x, y, comp, req_comp);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF float* stbi_decoder_loadf_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* comp, int req_comp)
+{
+	float* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, clbk, user);
+	result = stbi__loadf_main(&s, x, y, comp, req_comp);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+#endif
+
+STBIDEF int stbi_decoder_info_from_memory(stbi_decoder* d, stbi_uc const* buffer, int len, int* x, int* y, int* comp)
+{
+	int result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_mem(&s, d, buffer, len);
+	result = stbi__info_main(&s, x, y, comp);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF int stbi_decoder_info_from_callbacks(stbi_decoder* d, stbi_io_callbacks const* clbk, void* user, int* x, int* y, int* comp)
+{
+	int result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, clbk, user);
+	result = stbi__info_main(&s, x, y, comp);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+#ifndef STBI_NO_STDIO
+// like the stbi_*_from_file functions, loads leave the file just after the
+// image and info calls leave it where it was
+STBIDEF stbi_uc* stbi_decoder_load_from_file(stbi_decoder* d, FILE* f, int* x, int* y, int* comp, int req_comp)
+{
+	stbi_uc* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, &stbi__stdio_callbacks, (void*)f);
+	result = stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
+	if (result)
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF int stbi_decoder_load_into_from_file(stbi_decoder* d, FILE* f, stbi_target const* target, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, &stbi__stdio_callbacks, (void*)f);
+	result = stbi__load_into_main(&s, target, x, y, comp, req_comp);
+	if (result)
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF int stbi_decoder_stream_from_file(stbi_decoder* d, FILE* f, stbi_row_sink sink, void* user, int band_rows, int* x, int* y, int* comp, int req_comp)
+{
+	int result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, &stbi__stdio_callbacks, (void*)f);
+	result = stbi__stream_main(&s, sink, user, band_rows, x, y, comp, req_comp);
+	if (result)
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+STBIDEF stbi_us* stbi_decoder_load_16_from_file(stbi_decoder* d, FILE* f, int* x, int* y, int* comp, int req_comp)
+{
+	stbi_us* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, &stbi__stdio_callbacks, (void*)f);
+	result = stbi__load_and_postprocess_16bit(&s, x, y, comp, req_comp);
+	if (result)
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+
+#ifndef STBI_NO_LINEAR
+STBIDEF float* stbi_decoder_loadf_from_file(stbi_decoder* d, FILE* f, int* x, int* y, int* comp, int req_comp)
+{
+	float* result;
+	stbi__context s;
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, &stbi__stdio_callbacks, (void*)f);
+	result = stbi__loadf_main(&s, x, y, comp, req_comp);
+	if (result)
+		fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+#endif
+
+STBIDEF int stbi_decoder_info_from_file(stbi_decoder* d, FILE* f, int* x, int* y, int* comp)
+{
+	int result;
+	stbi__context s;
+	long pos = ftell(f);
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__decoder_start_callbacks(&s, d, &stbi__stdio_callbacks, (void*)f);
+	result = stbi__info_main(&s, x, y, comp);
+	fseek(f, pos, SEEK_SET);
+	stbi__stop_callbacks(&s);
+	stbi__decoder_end(prev);
+	return result;
+}
+#endif // !STBI_NO_STDIO
+
+STBIDEF void stbi_decoder_image_free(stbi_decoder* d, void* retval_from_stbi_decoder_load)
+{
+	stbi_decoder* prev = stbi__decoder_begin(d);
+	stbi__free(retval_from_stbi_decoder_load);
+	stbi__decoder_end(prev);
+}
+
+static void* stbi__arena_malloc(void* user, size_t size)
+{
+	stbi_arena* a = (stbi_arena*)user;
+	size_t start = (((size_t)(a->base + a->used) + 15) & ~(size_t)15) - (size_t)a->base;
+	if (start > a->size || size > a->size - start)
+		return NULL;
+	a->top = start;
+	a->used = start + size;
+	if (a->used > a->high_water)
+		a->high_water = a->used;
+	return a->base + start;
+}
+
+static void* stbi__arena_realloc(void* user, void* p, size_t oldsize, size_t newsize)
+{
+	stbi_arena* a = (stbi_arena*)user;
+	void* q;
+	if (p == NULL)
+		return stbi__arena_malloc(user, newsize);
+	if ((stbi_uc*)p == a->base + a->top) {
+		// the newest block can simply move the end of the arena
+		if (newsize > a->size - a->top)
+			return NULL;
+		a->used = a->top + newsize;
+		if (a->used > a->high_water)
+			a->high_water = a->used;
+		return p;
+	}
+	q = stbi__arena_malloc(user, newsize);
+	if (q)
+		memcpy(q, p, oldsize < newsize ? oldsize : newsize);
+	return q;
+}
+
+static void stbi__arena_free(void* user, void* p)
+{
+	stbi_arena* a = (stbi_arena*)user;
+	if (p && (stbi_uc*)p == a->base + a->top)
+		a->used = a->top;
+}
+
+STBIDEF void stbi_arena_init(stbi_arena* arena, void* memory, size_t size)
+{
+	arena->base = (stbi_uc*)memory;
+	arena->size = size;
+	arena->used = arena->top = arena->high_water = 0;
+}
+
+STBIDEF void stbi_arena_reset(stbi_arena* arena)
+{
+	arena->used = arena->top = 0;
+}
+
+STBIDEF stbi_allocator stbi_arena_allocator(stbi_arena* arena)
+{
+	stbi_allocator alloc;
+	alloc.malloc_fn = stbi__arena_malloc;
+	alloc.realloc_fn = stbi__arena_realloc;
+	alloc.free_fn = stbi__arena_free;
+	alloc.user = arena;
+	return alloc;
 }
 
 #endif // STB_IMAGE_IMPLEMENTATION